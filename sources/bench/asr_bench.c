@@ -0,0 +1,325 @@
+/*
+ * Offline benchmark: loads the module against the core stand-in (fs_standin.c) and replays WAV files
+ * through asr_open/asr_feed/asr_get_results from N concurrent simulated calls.
+ * Every utterance is a separate asr handle (the way play_and_detect_speech uses it), followed by silence
+ * so the vad can close it. Prints RTF, per-utterance latency percentiles, CPU time, peak RSS and the module status.
+ *
+ * usage: whisper_asr_bench -c <whisper_asr.conf.xml> -w <wav-dir|wav-file> [-n calls] [-u utterances-per-call]
+ *                          [-x speed] [-s silence-ms] [-p name=value[,name=value]] [-t timeout-sec] [-r reload-ms] [-j] [-v]
+ *
+ *   -x speed   1 = real time (default), 0 = as fast as possible (long files may overflow the audio ring)
+ *   -r ms      'whisper_asr reload' that long after the calls started (no call should fail)
+ *   -j         print the summary as a single json line (for regression scripts)
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ */
+#include "fs_standin.h"
+#include "wavfile.h"
+#include <pthread.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define BENCH_FRAME_MS      20
+#define BENCH_POLL_US       5000
+
+SWITCH_MODULE_LOAD_FUNCTION(mod_whisper_asr_load);
+SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_whisper_asr_shutdown);
+
+typedef struct {
+    switch_asr_interface_t  *asr;
+    wavfile_t               *files;
+    int                     nfiles;
+    uint32_t                calls;
+    uint32_t                utterances;
+    uint32_t                silence_ms;
+    uint32_t                timeout_sec;
+    uint32_t                reload_ms;
+    double                  speed;
+    char                    *params;
+    uint8_t                 fl_verbose;
+    //
+    pthread_mutex_t         mutex;
+    double                  *latency_ms;
+    uint32_t                latency_count;
+    uint32_t                no_result;
+    uint32_t                partials;
+    uint32_t                open_failed;
+    double                  audio_sec;
+} bench_t;
+
+typedef struct {
+    bench_t                 *bench;
+    uint32_t                id;
+} bench_call_t;
+
+static double time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000.0) + (ts.tv_nsec / 1000.0);
+}
+
+static void pace(double *next_us, double frame_us, double speed) {
+    double now = 0;
+
+    if(speed <= 0) {
+        return;
+    }
+    *next_us += (frame_us / speed);
+    if((now = time_us()) < *next_us) {
+        switch_sleep((switch_interval_time_t)(*next_us - now));
+    }
+}
+
+static void apply_params(switch_asr_handle_t *ah, const char *params) {
+    char *dup = NULL, *argv[32] = { 0 };
+    int argc = 0;
+
+    if(zstr(params) || !(dup = strdup(params))) {
+        return;
+    }
+    argc = switch_separate_string(dup, ',', argv, (sizeof(argv) / sizeof(argv[0])));
+    for(int i = 0; i < argc; i++) {
+        char *val = strchr(argv[i], '=');
+        if(val) {
+            *val++ = '\0';
+            ah->asr_interface->asr_text_param(ah, argv[i], val);
+        }
+    }
+    free(dup);
+}
+
+/* returns SWITCH_TRUE when a final result was taken */
+static uint8_t poll_results(bench_t *bench, switch_asr_handle_t *ah, uint32_t call_id, uint32_t *partials) {
+    switch_asr_flag_t flags = 0;
+    uint8_t fl_final = SWITCH_FALSE;
+
+    while(ah->asr_interface->asr_check_results(ah, &flags) == SWITCH_STATUS_SUCCESS) {
+        switch_status_t status = SWITCH_STATUS_FALSE;
+        char *result = NULL;
+
+        status = ah->asr_interface->asr_get_results(ah, &result, &flags);
+        if(status == SWITCH_STATUS_SUCCESS) {
+            fl_final = SWITCH_TRUE;
+        } else if(status == SWITCH_STATUS_MORE_DATA) {
+            (*partials)++;
+        }
+        if(bench->fl_verbose && result) {
+            fprintf(stderr, "call #%u: %s: %s", call_id, (status == SWITCH_STATUS_SUCCESS ? "final" : "partial"), result);
+        }
+        switch_safe_free(result);
+    }
+
+    return fl_final;
+}
+
+static void *call_thread(void *obj) {
+    bench_call_t *call = (bench_call_t *)obj;
+    bench_t *bench = call->bench;
+
+    for(uint32_t u = 0; u < bench->utterances; u++) {
+        wavfile_t *wav = &bench->files[(call->id + u) % bench->nfiles];
+        uint32_t frame_smps = (wav->samplerate * BENCH_FRAME_MS / 1000);
+        uint32_t silence_frames = (bench->silence_ms / BENCH_FRAME_MS);
+        int16_t *silence = calloc(frame_smps, sizeof(int16_t));
+        switch_asr_handle_t ah = { 0 };
+        switch_asr_flag_t flags = 0;
+        double next_us = 0, end_us = 0, deadline_us = 0;
+        uint32_t partials = 0;
+        uint8_t fl_final = SWITCH_FALSE;
+
+        ah.asr_interface = bench->asr;
+        switch_core_new_memory_pool(&ah.memory_pool);
+
+        if(!silence || bench->asr->asr_open(&ah, "L16", wav->samplerate, NULL, &flags) != SWITCH_STATUS_SUCCESS) {
+            pthread_mutex_lock(&bench->mutex);
+            bench->open_failed++;
+            pthread_mutex_unlock(&bench->mutex);
+            switch_core_destroy_memory_pool(&ah.memory_pool);
+            free(silence);
+            continue;
+        }
+        apply_params(&ah, bench->params);
+
+        next_us = time_us();
+        for(uint32_t ofs = 0; ofs < wav->nsamples; ofs += frame_smps) {
+            uint32_t len = MIN(frame_smps, (wav->nsamples - ofs));
+
+            // the module (and the core) work with whole frames, the tail is padded by the silence below
+            if(len == frame_smps) {
+                bench->asr->asr_feed(&ah, (wav->samples + ofs), (len * sizeof(int16_t)), &flags);
+            }
+            fl_final |= poll_results(bench, &ah, call->id, &partials);
+            pace(&next_us, (BENCH_FRAME_MS * 1000.0), bench->speed);
+        }
+        end_us = time_us();
+
+        for(uint32_t i = 0; i < silence_frames && !fl_final; i++) {
+            bench->asr->asr_feed(&ah, silence, (frame_smps * sizeof(int16_t)), &flags);
+            fl_final |= poll_results(bench, &ah, call->id, &partials);
+            pace(&next_us, (BENCH_FRAME_MS * 1000.0), bench->speed);
+        }
+
+        deadline_us = time_us() + (bench->timeout_sec * 1000000.0);
+        while(!fl_final && time_us() < deadline_us) {
+            switch_sleep(BENCH_POLL_US);
+            fl_final |= poll_results(bench, &ah, call->id, &partials);
+        }
+
+        pthread_mutex_lock(&bench->mutex);
+        if(fl_final) {
+            bench->latency_ms[bench->latency_count++] = ((time_us() - end_us) / 1000.0);
+        } else {
+            bench->no_result++;
+        }
+        bench->partials += partials;
+        bench->audio_sec += ((double)wav->nsamples / wav->samplerate);
+        pthread_mutex_unlock(&bench->mutex);
+
+        bench->asr->asr_close(&ah, &flags);
+        switch_core_destroy_memory_pool(&ah.memory_pool);
+        free(silence);
+    }
+
+    return NULL;
+}
+
+static void *reload_thread(void *obj) {
+    bench_t *bench = (bench_t *)obj;
+
+    switch_sleep((switch_interval_time_t)bench->reload_ms * 1000);
+    standin_api_execute("whisper_asr", "reload");
+
+    return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+static double percentile(double *v, uint32_t n, double p) {
+    return (n ? v[MIN((uint32_t)(p * n), n - 1)] : 0.0);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s -c <whisper_asr.conf.xml> -w <wav-dir|wav-file> [-n calls] [-u utterances-per-call] "
+                    "[-x speed] [-s silence-ms] [-p name=value[,name=value]] [-t timeout-sec] [-r reload-ms] [-j] [-v]\n", name);
+}
+
+int main(int argc, char **argv) {
+    switch_loadable_module_interface_t *module_interface = NULL;
+    switch_memory_pool_t *pool = NULL;
+    bench_t bench = { 0 };
+    bench_call_t *calls = NULL;
+    pthread_t *threads = NULL, reloader;
+    const char *config = NULL, *wavs = NULL;
+    struct rusage ru = { 0 };
+    double t0 = 0, wall_sec = 0, cpu_sec = 0;
+    uint8_t fl_json = SWITCH_FALSE;
+    int opt = 0, rc = 0;
+
+    bench.calls = 1;
+    bench.speed = 1.0;
+    bench.silence_ms = 1000;
+    bench.timeout_sec = 60;
+    pthread_mutex_init(&bench.mutex, NULL);
+
+    while((opt = getopt(argc, argv, "c:w:n:u:x:s:p:t:r:jv")) != -1) {
+        switch(opt) {
+            case 'c': config = optarg; break;
+            case 'w': wavs = optarg; break;
+            case 'n': bench.calls = MAX(atoi(optarg), 1); break;
+            case 'u': bench.utterances = atoi(optarg); break;
+            case 'x': bench.speed = atof(optarg); break;
+            case 's': bench.silence_ms = atoi(optarg); break;
+            case 'p': bench.params = optarg; break;
+            case 't': bench.timeout_sec = atoi(optarg); break;
+            case 'r': bench.reload_ms = atoi(optarg); break;
+            case 'j': fl_json = SWITCH_TRUE; break;
+            case 'v': bench.fl_verbose = SWITCH_TRUE; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if(!config || !wavs) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if((bench.nfiles = wavfile_load_list(wavs, &bench.files)) <= 0) {
+        fprintf(stderr, "No wav files loaded from: %s\n", wavs);
+        return 1;
+    }
+    bench.utterances = (bench.utterances ? bench.utterances : (uint32_t)bench.nfiles);
+
+    standin_init(config, (bench.fl_verbose ? SWITCH_LOG_DEBUG : SWITCH_LOG_WARNING));
+    switch_core_new_memory_pool(&pool);
+
+    if(mod_whisper_asr_load(&module_interface, pool) != SWITCH_STATUS_SUCCESS || !(bench.asr = standin_asr_interface("whisper"))) {
+        fprintf(stderr, "Unable to load the module (config: %s)\n", config);
+        return 1;
+    }
+
+    bench.latency_ms = calloc((size_t)bench.calls * bench.utterances, sizeof(double));
+    calls = calloc(bench.calls, sizeof(bench_call_t));
+    threads = calloc(bench.calls, sizeof(pthread_t));
+
+    t0 = time_us();
+    for(uint32_t i = 0; i < bench.calls; i++) {
+        calls[i].bench = &bench;
+        calls[i].id = i;
+        pthread_create(&threads[i], NULL, call_thread, &calls[i]);
+    }
+    if(bench.reload_ms) {
+        pthread_create(&reloader, NULL, reload_thread, &bench);
+    }
+    for(uint32_t i = 0; i < bench.calls; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if(bench.reload_ms) {
+        pthread_join(reloader, NULL);
+    }
+    wall_sec = ((time_us() - t0) / 1000000.0);
+
+    getrusage(RUSAGE_SELF, &ru);
+    cpu_sec = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) + ((ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000.0);
+    qsort(bench.latency_ms, bench.latency_count, sizeof(double), cmp_double);
+
+    if(fl_json) {
+        printf("{\"calls\":%u,\"utterances\":%u,\"no_result\":%u,\"open_failed\":%u,\"partials\":%u,\"events\":%u,\"audio_sec\":%.3f,\"wall_sec\":%.3f,"
+               "\"rtf\":%.4f,\"cpu_sec\":%.3f,\"cpu_per_audio_sec\":%.4f,\"peak_rss_kb\":%ld,"
+               "\"latency_ms\":{\"p50\":%.1f,\"p90\":%.1f,\"p95\":%.1f,\"p99\":%.1f,\"max\":%.1f}}\n",
+            bench.calls, (bench.calls * bench.utterances), bench.no_result, bench.open_failed, bench.partials, standin_events_fired(), bench.audio_sec, wall_sec,
+            (bench.audio_sec > 0 ? (wall_sec / bench.audio_sec) : 0.0), cpu_sec, (bench.audio_sec > 0 ? (cpu_sec / bench.audio_sec) : 0.0), ru.ru_maxrss,
+            percentile(bench.latency_ms, bench.latency_count, 0.50), percentile(bench.latency_ms, bench.latency_count, 0.90),
+            percentile(bench.latency_ms, bench.latency_count, 0.95), percentile(bench.latency_ms, bench.latency_count, 0.99),
+            percentile(bench.latency_ms, bench.latency_count, 1.0));
+    } else {
+        printf("calls: %u, utterances: %u (no result: %u, open failed: %u), partials: %u, events: %u\n",
+            bench.calls, (bench.calls * bench.utterances), bench.no_result, bench.open_failed, bench.partials, standin_events_fired());
+        printf("audio: %.1f sec, wall: %.1f sec, rtf: %.4f (%.1fx real time)\n",
+            bench.audio_sec, wall_sec, (bench.audio_sec > 0 ? (wall_sec / bench.audio_sec) : 0.0), (wall_sec > 0 ? (bench.audio_sec / wall_sec) : 0.0));
+        printf("cpu: %.1f sec (%.3f per audio sec), peak rss: %ld KB\n",
+            cpu_sec, (bench.audio_sec > 0 ? (cpu_sec / bench.audio_sec) : 0.0), ru.ru_maxrss);
+        printf("latency (end of audio -> final result, includes vad silence): p50=%.1f p90=%.1f p95=%.1f p99=%.1f max=%.1f ms\n",
+            percentile(bench.latency_ms, bench.latency_count, 0.50), percentile(bench.latency_ms, bench.latency_count, 0.90),
+            percentile(bench.latency_ms, bench.latency_count, 0.95), percentile(bench.latency_ms, bench.latency_count, 0.99),
+            percentile(bench.latency_ms, bench.latency_count, 1.0));
+        printf("\n");
+        standin_api_execute("whisper_asr", "status");
+    }
+
+    mod_whisper_asr_shutdown();
+    switch_core_destroy_memory_pool(&pool);
+
+    rc = ((bench.no_result || bench.open_failed) ? 2 : 0);
+
+    wavfile_free_list(bench.files, bench.nfiles);
+    free(bench.latency_ms);
+    free(calls);
+    free(threads);
+
+    return rc;
+}
@@ -0,0 +1,124 @@
+/*
+ * Encoder window benchmark: transcribes a set of (short) WAV files with the full 30 sec
+ * encoder window and with silence trimming + adaptive audio_ctx, and prints the RTF of both.
+ *
+ * usage: whisper_asr_audio_ctx_bench <model> <wav-dir|wav-file> [threads] [vad-threshold]
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ */
+#include "mod_whisper_asr.h"
+#include "wavfile.h"
+#include <time.h>
+
+static double time_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+static double run(struct whisper_context *wctx, struct whisper_state *wstate, float *audio, uint32_t samples, int32_t audio_ctx, uint32_t threads, char *text, size_t text_len) {
+    struct whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+    double t0 = 0, t1 = 0;
+    int segments = 0;
+
+    wparams.print_progress   = false;
+    wparams.print_special    = false;
+    wparams.print_realtime   = false;
+    wparams.print_timestamps = false;
+    wparams.language         = "en";
+    wparams.n_threads        = threads;
+    wparams.audio_ctx        = audio_ctx;
+
+    t0 = time_ms();
+    whisper_full_with_state(wctx, wstate, wparams, audio, samples);
+    t1 = time_ms();
+
+    text[0] = '\0';
+    segments = whisper_full_n_segments_from_state(wstate);
+    for(int i = 0; i < segments; i++) {
+        strncat(text, whisper_full_get_segment_text_from_state(wstate, i), text_len - strlen(text) - 1);
+    }
+
+    return (t1 - t0);
+}
+
+int main(int argc, char **argv) {
+    struct whisper_context_params cparams = whisper_context_default_params();
+    struct whisper_context *wctx = NULL;
+    struct whisper_state *wstate = NULL;
+    wavfile_t *files = NULL;
+    uint32_t threads = 4, vad_threshold = 100;
+    double total_audio = 0, total_full = 0, total_adaptive = 0;
+    char text[4096];
+    int nfiles = 0;
+
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s <model> <wav-dir|wav-file> [threads] [vad-threshold]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 3) { threads = atoi(argv[3]); }
+    if(argc > 4) { vad_threshold = atoi(argv[4]); }
+
+    if((nfiles = wavfile_load_list(argv[2], &files)) == 0) {
+        fprintf(stderr, "No wav files found: %s\n", argv[2]);
+        return 1;
+    }
+    if((wctx = whisper_init_from_file_with_params_no_state(argv[1], cparams)) == NULL || (wstate = whisper_init_state(wctx)) == NULL) {
+        fprintf(stderr, "Unable to load model: %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("%-32s %8s %8s %10s %10s %8s %8s\n", "file", "sec", "ctx", "full RTF", "adapt RTF", "speedup", "trimmed");
+
+    for(int i = 0; i < nfiles; i++) {
+        wavfile_t *wav = &files[i];
+        uint32_t max_smps = ((uint64_t)wav->nsamples * WHISPER_SAMPLE_RATE / wav->samplerate) + RESAMPLE_BLOCK_SIZE;
+        float *audio = malloc(max_smps * sizeof(float));
+        uint32_t samples = 0, trimmed = 0, ofs = 0;
+        double sec = 0, t_full = 0, t_adaptive = 0;
+        int32_t audio_ctx = 0;
+
+        if(wav->samplerate != WHISPER_SAMPLE_RATE) {
+            int err = 0;
+            SpeexResamplerState *resampler = speex_resampler_init(1, wav->samplerate, WHISPER_SAMPLE_RATE, SWITCH_RESAMPLE_QUALITY, &err);
+            samples = resample_to_float(resampler, wav->samples, wav->nsamples, audio, max_smps);
+            speex_resampler_destroy(resampler);
+        } else {
+            i2f(wav->samples, audio, wav->nsamples);
+            samples = wav->nsamples;
+        }
+        sec = (double)samples / WHISPER_SAMPLE_RATE;
+
+        // warm-up on the first file, so the graph allocation isn't counted
+        if(i == 0) { run(wctx, wstate, audio, samples, 0, threads, text, sizeof(text)); }
+
+        t_full = run(wctx, wstate, audio, samples, 0, threads, text, sizeof(text));
+        printf("  full: %s\n", text);
+
+        trimmed = trim_silence(audio, samples, vad_threshold, DEF_TRIM_PAD_MS, &ofs);
+        audio_ctx = audio_ctx_calc(AUDIO_CTX_AUTO, trimmed, DEF_AUDIO_CTX_MIN, DEF_AUDIO_CTX_PAD, whisper_model_n_audio_ctx(wctx));
+
+        t_adaptive = run(wctx, wstate, audio + ofs, trimmed, audio_ctx, threads, text, sizeof(text));
+        printf("  adpt: %s\n", text);
+
+        printf("%-32s %8.2f %8d %10.3f %10.3f %7.2fx %7.1f%%\n", wav->name, sec, audio_ctx,
+            (t_full / 1000.0) / sec, (t_adaptive / 1000.0) / sec, (t_adaptive > 0 ? t_full / t_adaptive : 0), 100.0 * (samples - trimmed) / samples);
+
+        total_audio += sec;
+        total_full += t_full;
+        total_adaptive += t_adaptive;
+
+        free(audio);
+    }
+
+    printf("total: %d files, %.2f sec of audio, RTF full=%.3f adaptive=%.3f (x%.2f)\n", nfiles, total_audio,
+        (total_full / 1000.0) / total_audio, (total_adaptive / 1000.0) / total_audio, (total_adaptive > 0 ? total_full / total_adaptive : 0));
+
+    whisper_free_state(wstate);
+    whisper_free(wctx);
+    wavfile_free_list(files, nfiles);
+
+    return 0;
+}
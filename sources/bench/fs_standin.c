@@ -0,0 +1,1259 @@
+/*
+ * Thin stand-in for the FreeSWITCH core (see fs_standin.h)
+ * Only the calls the module makes are here, with the same semantics as far as the module relies on them.
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ */
+#include "fs_standin.h"
+#include <pthread.h>
+#include <errno.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define STANDIN_MAX_INTERFACES 16
+
+typedef struct {
+    const char              *config_path;
+    switch_log_level_t      log_level;
+    pthread_mutex_t         log_lock;
+    switch_asr_interface_t  *asr_interfaces[STANDIN_MAX_INTERFACES];
+    switch_api_interface_t  *api_interfaces[STANDIN_MAX_INTERFACES];
+    uint32_t                asr_count;
+    uint32_t                api_count;
+    uint32_t                events_fired;
+} standin_globals_t;
+
+static standin_globals_t sglobals = { .log_level = SWITCH_LOG_WARNING, .log_lock = PTHREAD_MUTEX_INITIALIZER };
+
+void standin_init(const char *config_path, switch_log_level_t log_level) {
+    sglobals.config_path = config_path;
+    sglobals.log_level = log_level;
+}
+
+switch_asr_interface_t *standin_asr_interface(const char *name) {
+    for(uint32_t i = 0; i < sglobals.asr_count; i++) {
+        if(!name || !strcasecmp(sglobals.asr_interfaces[i]->interface_name, name)) {
+            return sglobals.asr_interfaces[i];
+        }
+    }
+    return NULL;
+}
+
+switch_api_interface_t *standin_api_interface(const char *name) {
+    for(uint32_t i = 0; i < sglobals.api_count; i++) {
+        if(!strcasecmp(sglobals.api_interfaces[i]->interface_name, name)) {
+            return sglobals.api_interfaces[i];
+        }
+    }
+    return NULL;
+}
+
+static switch_status_t standin_stream_write(switch_stream_handle_t *handle, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stdout, fmt, ap);
+    va_end(ap);
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t standin_api_execute(const char *name, const char *cmd) {
+    switch_api_interface_t *api = standin_api_interface(name);
+    switch_stream_handle_t stream = { 0 };
+
+    if(!api || !api->function) {
+        return SWITCH_STATUS_NOTFOUND;
+    }
+
+    stream.write_function = standin_stream_write;
+    return api->function(cmd, NULL, &stream);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// log, time
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+static const char *log_level_names[] = { "CONSOLE", "ALERT", "CRIT", "ERR", "WARNING", "NOTICE", "INFO", "DEBUG" };
+
+void switch_log_printf(switch_text_channel_t channel, const char *file, const char *func, int line, const char *userdata, switch_log_level_t level, const char *fmt, ...) {
+    va_list ap;
+
+    if(level > sglobals.log_level) {
+        return;
+    }
+
+    pthread_mutex_lock(&sglobals.log_lock);
+    fprintf(stderr, "[%s] %s:%d ", (level >= 0 && level <= SWITCH_LOG_DEBUG ? log_level_names[level] : "DEBUG"), file, line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    pthread_mutex_unlock(&sglobals.log_lock);
+}
+
+switch_time_t switch_micro_time_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((switch_time_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void switch_sleep(switch_interval_time_t t) {
+    struct timespec ts = { .tv_sec = (t / 1000000), .tv_nsec = ((t % 1000000) * 1000) };
+    while(nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+uint32_t switch_core_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0 ? (uint32_t)n : 1);
+}
+
+switch_status_t switch_file_exists(const char *filename, switch_memory_pool_t *pool) {
+    struct stat st;
+    return ((filename && stat(filename, &st) == 0) ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE);
+}
+
+char *switch_copy_string(char *to, const char *from, switch_size_t to_len) {
+    if(!to || !to_len) {
+        return to;
+    }
+    snprintf(to, to_len, "%s", (from ? from : ""));
+    return to;
+}
+
+// no channels here, channel variables set by the module go nowhere
+switch_core_session_t *switch_core_session_perform_locate(const char *uuid_str, const char *file, const char *func, int line) {
+    return NULL;
+}
+
+void switch_core_session_rwunlock(switch_core_session_t *session) {
+}
+
+switch_channel_t *switch_core_session_get_channel(switch_core_session_t *session) {
+    return NULL;
+}
+
+switch_status_t switch_channel_set_variable_var_check(switch_channel_t *channel, const char *varname, const char *value, switch_bool_t var_check) {
+    return SWITCH_STATUS_FALSE;
+}
+
+unsigned int switch_separate_string(char *buf, char delim, char **array, unsigned int arraylen) {
+    unsigned int argc = 0;
+    char *p = buf;
+
+    if(!buf || !array || !arraylen) {
+        return 0;
+    }
+
+    while(*p && argc < arraylen) {
+        while(*p == delim) { *p++ = '\0'; }
+        if(!*p) { break; }
+        array[argc++] = p;
+        if(argc == arraylen) { break; }
+        while(*p && *p != delim) { p++; }
+    }
+
+    return argc;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// memory pools: every allocation is zeroed and released with the pool
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+typedef struct standin_block_s {
+    struct standin_block_s  *next;
+} standin_block_t;
+
+typedef struct {
+    pthread_mutex_t         lock;
+    standin_block_t         *blocks;
+} standin_pool_t;
+
+switch_status_t switch_core_perform_new_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line) {
+    standin_pool_t *p = calloc(1, sizeof(standin_pool_t));
+
+    if(!p) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    *pool = (switch_memory_pool_t *)p;
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_core_perform_destroy_memory_pool(switch_memory_pool_t **pool, const char *file, const char *func, int line) {
+    standin_pool_t *p = (standin_pool_t *)*pool;
+
+    if(!p) {
+        return SWITCH_STATUS_FALSE;
+    }
+    while(p->blocks) {
+        standin_block_t *b = p->blocks;
+        p->blocks = b->next;
+        free(b);
+    }
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+    *pool = NULL;
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void *switch_core_perform_alloc(switch_memory_pool_t *pool, switch_size_t memory, const char *file, const char *func, int line) {
+    standin_pool_t *p = (standin_pool_t *)pool;
+    standin_block_t *b = NULL;
+
+    // keep the payload 16 bytes aligned (float/simd buffers)
+    if(!(b = calloc(1, 16 + memory))) {
+        return NULL;
+    }
+    if(p) {
+        pthread_mutex_lock(&p->lock);
+        b->next = p->blocks;
+        p->blocks = b;
+        pthread_mutex_unlock(&p->lock);
+    }
+
+    return ((uint8_t *)b + 16);
+}
+
+char *switch_core_perform_strdup(switch_memory_pool_t *pool, const char *todup, const char *file, const char *func, int line) {
+    char *s = NULL;
+
+    if(!todup) {
+        return NULL;
+    }
+    if((s = switch_core_perform_alloc(pool, strlen(todup) + 1, file, func, line))) {
+        strcpy(s, todup);
+    }
+
+    return s;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// mutex, cond, threads
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+typedef struct {
+    pthread_mutex_t         mutex;
+} standin_mutex_t;
+
+typedef struct {
+    pthread_cond_t          cond;
+} standin_cond_t;
+
+typedef struct {
+    size_t                  stacksize;
+    int                     detach;
+} standin_threadattr_t;
+
+typedef struct {
+    pthread_t               thread;
+    switch_thread_start_t   func;
+    void                    *data;
+} standin_thread_t;
+
+static void timespec_after(struct timespec *ts, switch_interval_time_t usec) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += (usec / 1000000);
+    ts->tv_nsec += ((usec % 1000000) * 1000);
+    if(ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+switch_status_t switch_mutex_init(switch_mutex_t **lock, unsigned int flags, switch_memory_pool_t *pool) {
+    standin_mutex_t *m = switch_core_alloc(pool, sizeof(standin_mutex_t));
+    pthread_mutexattr_t attr;
+
+    if(!m) {
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    pthread_mutexattr_init(&attr);
+    if(flags & SWITCH_MUTEX_NESTED) {
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    }
+    pthread_mutex_init(&m->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    *lock = (switch_mutex_t *)m;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_destroy(switch_mutex_t *lock) {
+    pthread_mutex_destroy(&((standin_mutex_t *)lock)->mutex);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_mutex_lock(switch_mutex_t *lock) {
+    return (pthread_mutex_lock(&((standin_mutex_t *)lock)->mutex) == 0 ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE);
+}
+
+switch_status_t switch_mutex_unlock(switch_mutex_t *lock) {
+    return (pthread_mutex_unlock(&((standin_mutex_t *)lock)->mutex) == 0 ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE);
+}
+
+switch_status_t switch_mutex_trylock(switch_mutex_t *lock) {
+    return (pthread_mutex_trylock(&((standin_mutex_t *)lock)->mutex) == 0 ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE);
+}
+
+switch_status_t switch_thread_cond_create(switch_thread_cond_t **cond, switch_memory_pool_t *pool) {
+    standin_cond_t *c = switch_core_alloc(pool, sizeof(standin_cond_t));
+    pthread_condattr_t attr;
+
+    if(!c) {
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    *cond = (switch_thread_cond_t *)c;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_wait(switch_thread_cond_t *cond, switch_mutex_t *mutex) {
+    pthread_cond_wait(&((standin_cond_t *)cond)->cond, &((standin_mutex_t *)mutex)->mutex);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_timedwait(switch_thread_cond_t *cond, switch_mutex_t *mutex, switch_interval_time_t timeout) {
+    struct timespec ts;
+
+    timespec_after(&ts, timeout);
+    if(pthread_cond_timedwait(&((standin_cond_t *)cond)->cond, &((standin_mutex_t *)mutex)->mutex, &ts) == ETIMEDOUT) {
+        return SWITCH_STATUS_TIMEOUT;
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_signal(switch_thread_cond_t *cond) {
+    pthread_cond_signal(&((standin_cond_t *)cond)->cond);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_broadcast(switch_thread_cond_t *cond) {
+    pthread_cond_broadcast(&((standin_cond_t *)cond)->cond);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_thread_cond_destroy(switch_thread_cond_t *cond) {
+    pthread_cond_destroy(&((standin_cond_t *)cond)->cond);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_threadattr_create(switch_threadattr_t **new_attr, switch_memory_pool_t *pool) {
+    standin_threadattr_t *a = switch_core_alloc(pool, sizeof(standin_threadattr_t));
+
+    if(!a) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    *new_attr = (switch_threadattr_t *)a;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_threadattr_detach_set(switch_threadattr_t *attr, int32_t on) {
+    ((standin_threadattr_t *)attr)->detach = on;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_threadattr_stacksize_set(switch_threadattr_t *attr, switch_size_t stacksize) {
+    ((standin_threadattr_t *)attr)->stacksize = stacksize;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static void *standin_thread_main(void *obj) {
+    standin_thread_t *t = (standin_thread_t *)obj;
+    return t->func((switch_thread_t *)t, t->data);
+}
+
+switch_status_t switch_thread_create(switch_thread_t **new_thread, switch_threadattr_t *attr, switch_thread_start_t func, void *data, switch_memory_pool_t *cont) {
+    standin_threadattr_t *a = (standin_threadattr_t *)attr;
+    standin_thread_t *t = switch_core_alloc(cont, sizeof(standin_thread_t));
+    pthread_attr_t pattr;
+    int err = 0;
+
+    if(!t) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    t->func = func;
+    t->data = data;
+
+    pthread_attr_init(&pattr);
+    if(a && a->stacksize) {
+        // whisper needs more than the default switch stack on the worker threads
+        pthread_attr_setstacksize(&pattr, MAX(a->stacksize, (8 * 1024 * 1024)));
+    }
+    if(a && a->detach) {
+        pthread_attr_setdetachstate(&pattr, PTHREAD_CREATE_DETACHED);
+    }
+    err = pthread_create(&t->thread, &pattr, standin_thread_main, t);
+    pthread_attr_destroy(&pattr);
+
+    if(err) {
+        return SWITCH_STATUS_GENERR;
+    }
+    *new_thread = (switch_thread_t *)t;
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// queue (bounded fifo)
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+typedef struct {
+    pthread_mutex_t         mutex;
+    pthread_cond_t          not_empty;
+    pthread_cond_t          not_full;
+    void                    **data;
+    unsigned int            capacity;
+    unsigned int            head;
+    unsigned int            count;
+    uint8_t                 fl_term;
+} standin_queue_t;
+
+switch_status_t switch_queue_create(switch_queue_t **queue, unsigned int queue_capacity, switch_memory_pool_t *pool) {
+    standin_queue_t *q = switch_core_alloc(pool, sizeof(standin_queue_t));
+    pthread_condattr_t attr;
+
+    if(!q || !(q->data = switch_core_alloc(pool, queue_capacity * sizeof(void *)))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    q->capacity = queue_capacity;
+
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&q->not_empty, &attr);
+    pthread_cond_init(&q->not_full, &attr);
+    pthread_condattr_destroy(&attr);
+
+    *queue = (switch_queue_t *)q;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static void queue_put(standin_queue_t *q, void *data) {
+    q->data[(q->head + q->count) % q->capacity] = data;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+}
+
+static void *queue_get(standin_queue_t *q) {
+    void *data = q->data[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+    return data;
+}
+
+switch_status_t switch_queue_push(switch_queue_t *queue, void *data) {
+    standin_queue_t *q = (standin_queue_t *)queue;
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&q->mutex);
+    while(q->count >= q->capacity && !q->fl_term) {
+        pthread_cond_wait(&q->not_full, &q->mutex);
+    }
+    if(q->fl_term) {
+        status = SWITCH_STATUS_TERM;
+    } else {
+        queue_put(q, data);
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    return status;
+}
+
+switch_status_t switch_queue_trypush(switch_queue_t *queue, void *data) {
+    standin_queue_t *q = (standin_queue_t *)queue;
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&q->mutex);
+    if(q->fl_term || q->count >= q->capacity) {
+        status = SWITCH_STATUS_FALSE;
+    } else {
+        queue_put(q, data);
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    return status;
+}
+
+switch_status_t switch_queue_pop_timeout(switch_queue_t *queue, void **data, switch_interval_time_t timeout) {
+    standin_queue_t *q = (standin_queue_t *)queue;
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+    struct timespec ts;
+
+    timespec_after(&ts, timeout);
+
+    pthread_mutex_lock(&q->mutex);
+    while(!q->count && !q->fl_term) {
+        if(pthread_cond_timedwait(&q->not_empty, &q->mutex, &ts) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if(q->count) {
+        *data = queue_get(q);
+    } else {
+        status = (q->fl_term ? SWITCH_STATUS_TERM : SWITCH_STATUS_TIMEOUT);
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    return status;
+}
+
+switch_status_t switch_queue_pop(switch_queue_t *queue, void **data) {
+    standin_queue_t *q = (standin_queue_t *)queue;
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&q->mutex);
+    while(!q->count && !q->fl_term) {
+        pthread_cond_wait(&q->not_empty, &q->mutex);
+    }
+    if(q->count) {
+        *data = queue_get(q);
+    } else {
+        status = SWITCH_STATUS_TERM;
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    return status;
+}
+
+switch_status_t switch_queue_trypop(switch_queue_t *queue, void **data) {
+    standin_queue_t *q = (standin_queue_t *)queue;
+    switch_status_t status = SWITCH_STATUS_FALSE;
+
+    pthread_mutex_lock(&q->mutex);
+    if(q->count) {
+        *data = queue_get(q);
+        status = SWITCH_STATUS_SUCCESS;
+    }
+    pthread_mutex_unlock(&q->mutex);
+
+    return status;
+}
+
+unsigned int switch_queue_size(switch_queue_t *queue) {
+    standin_queue_t *q = (standin_queue_t *)queue;
+    unsigned int count = 0;
+
+    pthread_mutex_lock(&q->mutex);
+    count = q->count;
+    pthread_mutex_unlock(&q->mutex);
+
+    return count;
+}
+
+switch_status_t switch_queue_interrupt_all(switch_queue_t *queue) {
+    standin_queue_t *q = (standin_queue_t *)queue;
+
+    pthread_mutex_lock(&q->mutex);
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_queue_term(switch_queue_t *queue) {
+    standin_queue_t *q = (standin_queue_t *)queue;
+
+    pthread_mutex_lock(&q->mutex);
+    q->fl_term = SWITCH_TRUE;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mutex);
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// buffer: contiguous storage, zero() rewinds to the beginning (the module relies on that for the vad pre-roll)
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+typedef struct {
+    uint8_t                 *data;
+    switch_size_t           head;
+    switch_size_t           used;
+    switch_size_t           datalen;
+    switch_size_t           blocksize;
+    switch_size_t           max_len;
+    uint8_t                 fl_dynamic;
+} standin_buffer_t;
+
+switch_status_t switch_buffer_create(switch_memory_pool_t *pool, switch_buffer_t **buffer, switch_size_t max_len) {
+    standin_buffer_t *b = switch_core_alloc(pool, sizeof(standin_buffer_t));
+
+    if(!b || !(b->data = switch_core_alloc(pool, max_len))) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    b->datalen = max_len;
+    b->max_len = max_len;
+
+    *buffer = (switch_buffer_t *)b;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_buffer_create_dynamic(switch_buffer_t **buffer, switch_size_t blocksize, switch_size_t start_len, switch_size_t max_len) {
+    standin_buffer_t *b = calloc(1, sizeof(standin_buffer_t));
+
+    if(!b || !(b->data = malloc(start_len))) {
+        free(b);
+        return SWITCH_STATUS_MEMERR;
+    }
+    b->datalen = start_len;
+    b->blocksize = blocksize;
+    b->max_len = max_len;
+    b->fl_dynamic = SWITCH_TRUE;
+
+    *buffer = (switch_buffer_t *)b;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_size_t switch_buffer_write(switch_buffer_t *buffer, const void *data, switch_size_t datalen) {
+    standin_buffer_t *b = (standin_buffer_t *)buffer;
+
+    if(!datalen) {
+        return b->used;
+    }
+
+    if(b->head + b->used + datalen > b->datalen && b->head) {
+        memmove(b->data, b->data + b->head, b->used);
+        b->head = 0;
+    }
+    if(b->used + datalen > b->datalen) {
+        switch_size_t need = b->used + datalen;
+        switch_size_t len = b->datalen;
+        uint8_t *tmp = NULL;
+
+        if(!b->fl_dynamic || (b->max_len && need > b->max_len)) {
+            return 0;
+        }
+        while(len < need) { len += (b->blocksize ? b->blocksize : need); }
+        if(b->max_len) { len = MIN(len, b->max_len); }
+        if(!(tmp = realloc(b->data, len))) {
+            return 0;
+        }
+        b->data = tmp;
+        b->datalen = len;
+    }
+
+    memcpy(b->data + b->head + b->used, data, datalen);
+    b->used += datalen;
+
+    return b->used;
+}
+
+switch_size_t switch_buffer_read(switch_buffer_t *buffer, void *data, switch_size_t datalen) {
+    standin_buffer_t *b = (standin_buffer_t *)buffer;
+    switch_size_t len = MIN(datalen, b->used);
+
+    memcpy(data, b->data + b->head, len);
+    b->head += len;
+    b->used -= len;
+    if(!b->used) { b->head = 0; }
+
+    return len;
+}
+
+switch_size_t switch_buffer_peek_zerocopy(switch_buffer_t *buffer, const void **ptr) {
+    standin_buffer_t *b = (standin_buffer_t *)buffer;
+
+    *ptr = (b->data + b->head);
+    return b->used;
+}
+
+switch_size_t switch_buffer_inuse(switch_buffer_t *buffer) {
+    return ((standin_buffer_t *)buffer)->used;
+}
+
+void switch_buffer_zero(switch_buffer_t *buffer) {
+    standin_buffer_t *b = (standin_buffer_t *)buffer;
+    b->head = 0;
+    b->used = 0;
+}
+
+void switch_buffer_destroy(switch_buffer_t **buffer) {
+    standin_buffer_t *b = (standin_buffer_t *)*buffer;
+
+    if(b && b->fl_dynamic) {
+        free(b->data);
+        free(b);
+    }
+    *buffer = NULL;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// vad: energy detector with the same params and state sequence as switch_vad (without libfvad)
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+typedef struct {
+    uint32_t                samplerate;
+    uint32_t                thresh;
+    uint32_t                voice_ms;
+    uint32_t                silence_ms;
+    uint32_t                voice_acc_ms;
+    uint32_t                silence_acc_ms;
+    switch_vad_state_t      state;
+} standin_vad_t;
+
+switch_vad_t *switch_vad_init(int sample_rate, int channels) {
+    standin_vad_t *v = calloc(1, sizeof(standin_vad_t));
+
+    if(v) {
+        v->samplerate = sample_rate;
+        v->thresh = 100;
+        v->voice_ms = 200;
+        v->silence_ms = 500;
+    }
+    return (switch_vad_t *)v;
+}
+
+int switch_vad_set_mode(switch_vad_t *vad, int mode) {
+    return 0;
+}
+
+void switch_vad_set_param(switch_vad_t *vad, const char *key, int val) {
+    standin_vad_t *v = (standin_vad_t *)vad;
+
+    if(!strcasecmp(key, "thresh")) {
+        v->thresh = val;
+    } else if(!strcasecmp(key, "voice_ms")) {
+        v->voice_ms = val;
+    } else if(!strcasecmp(key, "silence_ms")) {
+        v->silence_ms = val;
+    }
+}
+
+switch_vad_state_t switch_vad_process(switch_vad_t *vad, int16_t *data, unsigned int samples) {
+    standin_vad_t *v = (standin_vad_t *)vad;
+    uint32_t frame_ms = (samples * 1000 / v->samplerate);
+    double energy = 0;
+    uint8_t fl_voice = SWITCH_FALSE;
+
+    for(unsigned int i = 0; i < samples; i++) {
+        energy += ((double)data[i] * data[i]);
+    }
+    fl_voice = (samples && sqrt(energy / samples) >= v->thresh);
+
+    if(v->state == SWITCH_VAD_STATE_STOP_TALKING) {
+        v->state = SWITCH_VAD_STATE_NONE;
+    }
+
+    if(v->state == SWITCH_VAD_STATE_NONE) {
+        v->voice_acc_ms = (fl_voice ? v->voice_acc_ms + frame_ms : 0);
+        if(v->voice_acc_ms >= v->voice_ms) {
+            v->silence_acc_ms = 0;
+            v->state = SWITCH_VAD_STATE_START_TALKING;
+        }
+    } else {
+        v->silence_acc_ms = (fl_voice ? 0 : v->silence_acc_ms + frame_ms);
+        if(v->silence_acc_ms >= v->silence_ms) {
+            v->voice_acc_ms = 0;
+            v->state = SWITCH_VAD_STATE_STOP_TALKING;
+        } else {
+            v->state = SWITCH_VAD_STATE_TALKING;
+        }
+    }
+
+    return v->state;
+}
+
+void switch_vad_reset(switch_vad_t *vad) {
+    standin_vad_t *v = (standin_vad_t *)vad;
+
+    v->state = SWITCH_VAD_STATE_NONE;
+    v->voice_acc_ms = 0;
+    v->silence_acc_ms = 0;
+}
+
+void switch_vad_destroy(switch_vad_t **vad) {
+    if(vad && *vad) {
+        free(*vad);
+        *vad = NULL;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// xml: tiny parser for config files (elements + attributes, no entities besides the basic ones)
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+static char *xml_unescape(const char *s, size_t len) {
+    static const struct { const char *ent; char ch; } ents[] = { {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''} };
+    char *out = malloc(len + 1), *o = out;
+
+    for(size_t i = 0; out && i < len; ) {
+        size_t k = 0;
+        if(s[i] == '&') {
+            for(k = 0; k < (sizeof(ents) / sizeof(ents[0])); k++) {
+                size_t el = strlen(ents[k].ent);
+                if(i + el <= len && !strncmp(s + i, ents[k].ent, el)) { *o++ = ents[k].ch; i += el; break; }
+            }
+            if(k < (sizeof(ents) / sizeof(ents[0]))) { continue; }
+        }
+        *o++ = s[i++];
+    }
+    if(out) { *o = '\0'; }
+
+    return out;
+}
+
+static void xml_add_child(switch_xml_t parent, switch_xml_t child) {
+    switch_xml_t c = parent->child, last = NULL;
+
+    child->parent = parent;
+    for(; c; last = c, c = c->sibling) {
+        if(!strcmp(c->name, child->name)) {
+            while(c->next) { c = c->next; }
+            c->next = child;
+            return;
+        }
+    }
+    if(last) {
+        last->sibling = child;
+    } else {
+        parent->child = child;
+    }
+}
+
+static void xml_free_node(switch_xml_t xml) {
+    while(xml) {
+        switch_xml_t sibling = xml->sibling;
+        switch_xml_t next = xml->next;
+
+        xml_free_node(xml->child);
+        if(xml->attr) {
+            for(uint32_t i = 0; xml->attr[i]; i++) { free(xml->attr[i]); }
+            free(xml->attr);
+        }
+        free(xml->name);
+        free(xml->txt);
+        free(xml);
+
+        // nodes with the same name hang on 'next' of the first one only
+        xml_free_node(next);
+        xml = sibling;
+    }
+}
+
+static switch_xml_t xml_parse(const char *s) {
+    switch_xml_t root = NULL, cur = NULL;
+    const char *p = s;
+
+    while(*p) {
+        if(*p != '<') {
+            const char *t = p;
+            while(*p && *p != '<') { p++; }
+            if(cur) {
+                while(t < p && isspace((unsigned char)*t)) { t++; }
+                if(t < p && !cur->txt) { cur->txt = xml_unescape(t, (p - t)); }
+            }
+            continue;
+        }
+        if(!strncmp(p, "<!--", 4)) {
+            const char *e = strstr(p, "-->");
+            p = (e ? e + 3 : p + strlen(p));
+            continue;
+        }
+        if(p[1] == '?' || p[1] == '!') {
+            const char *e = strchr(p, '>');
+            p = (e ? e + 1 : p + strlen(p));
+            continue;
+        }
+        if(p[1] == '/') {
+            const char *e = strchr(p, '>');
+            if(cur) { cur = cur->parent; }
+            p = (e ? e + 1 : p + strlen(p));
+            continue;
+        } else {
+            switch_xml_t node = calloc(1, sizeof(*node));
+            uint32_t nattr = 0;
+            const char *n = ++p;
+
+            while(*p && !isspace((unsigned char)*p) && *p != '>' && *p != '/') { p++; }
+            node->name = strndup(n, (p - n));
+            node->attr = calloc(1, sizeof(char *));
+
+            while(*p && *p != '>' && *p != '/') {
+                const char *an = NULL, *av = NULL;
+                char q = 0;
+
+                while(isspace((unsigned char)*p)) { p++; }
+                if(!*p || *p == '>' || *p == '/') { break; }
+
+                an = p;
+                while(*p && *p != '=' && !isspace((unsigned char)*p) && *p != '>') { p++; }
+                node->attr = realloc(node->attr, (nattr + 3) * sizeof(char *));
+                node->attr[nattr] = strndup(an, (p - an));
+
+                while(isspace((unsigned char)*p)) { p++; }
+                if(*p == '=') {
+                    p++;
+                    while(isspace((unsigned char)*p)) { p++; }
+                    if(*p == '"' || *p == '\'') { q = *p++; }
+                    av = p;
+                    while(*p && (q ? *p != q : (!isspace((unsigned char)*p) && *p != '>'))) { p++; }
+                    node->attr[nattr + 1] = xml_unescape(av, (p - av));
+                    if(q && *p) { p++; }
+                } else {
+                    node->attr[nattr + 1] = strdup("");
+                }
+                nattr += 2;
+                node->attr[nattr] = NULL;
+            }
+
+            if(cur) {
+                xml_add_child(cur, node);
+            } else if(!root) {
+                root = node;
+            } else {
+                xml_free_node(node);
+                node = NULL;
+            }
+
+            if(*p == '/') {
+                while(*p && *p != '>') { p++; }
+            } else if(node) {
+                cur = node;
+            }
+            if(*p) { p++; }
+        }
+    }
+
+    return root;
+}
+
+static switch_xml_t xml_find(switch_xml_t xml, const char *name) {
+    for(; xml; xml = xml->sibling) {
+        switch_xml_t found = NULL;
+        if(!strcmp(xml->name, name)) {
+            return xml;
+        }
+        if((found = xml_find(xml->child, name))) {
+            return found;
+        }
+    }
+    return NULL;
+}
+
+switch_xml_t switch_xml_open_cfg(const char *file_path, switch_xml_t *node, switch_event_t *params) {
+    switch_xml_t root = NULL;
+    char *text = NULL;
+    FILE *fp = NULL;
+    long len = 0;
+
+    if(!sglobals.config_path || !(fp = fopen(sglobals.config_path, "rb"))) {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if(len > 0 && (text = calloc(1, len + 1)) && fread(text, 1, len, fp) == (size_t)len) {
+        root = xml_parse(text);
+    }
+    free(text);
+    fclose(fp);
+
+    if(root && !(*node = xml_find(root, "configuration"))) {
+        xml_free_node(root);
+        root = NULL;
+    }
+
+    return root;
+}
+
+switch_xml_t switch_xml_child(switch_xml_t xml, const char *name) {
+    switch_xml_t c = (xml ? xml->child : NULL);
+
+    while(c && strcmp(name, c->name)) {
+        c = c->sibling;
+    }
+    return c;
+}
+
+const char *switch_xml_attr(switch_xml_t xml, const char *attr) {
+    if(!xml || !xml->attr) {
+        return NULL;
+    }
+    for(uint32_t i = 0; xml->attr[i]; i += 2) {
+        if(!strcmp(xml->attr[i], attr)) {
+            return xml->attr[i + 1];
+        }
+    }
+    return NULL;
+}
+
+const char *switch_xml_attr_soft(switch_xml_t xml, const char *attr) {
+    const char *v = switch_xml_attr(xml, attr);
+    return (v ? v : "");
+}
+
+void switch_xml_free(switch_xml_t xml) {
+    xml_free_node(xml);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// loadable module interfaces
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+switch_loadable_module_interface_t *switch_loadable_module_create_module_interface(switch_memory_pool_t *pool, const char *name) {
+    return (switch_loadable_module_interface_t *)switch_core_strdup(pool, name);
+}
+
+void *switch_loadable_module_create_interface(switch_loadable_module_interface_t *mod, switch_module_interface_name_t iname) {
+    if(iname == SWITCH_ASR_INTERFACE && sglobals.asr_count < STANDIN_MAX_INTERFACES) {
+        return (sglobals.asr_interfaces[sglobals.asr_count++] = calloc(1, sizeof(switch_asr_interface_t)));
+    }
+    if(iname == SWITCH_API_INTERFACE && sglobals.api_count < STANDIN_MAX_INTERFACES) {
+        return (sglobals.api_interfaces[sglobals.api_count++] = calloc(1, sizeof(switch_api_interface_t)));
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// events: counted and dropped, the handle is a private struct behind switch_event_t
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+typedef struct {
+    char                    *subclass;
+    char                    *body;
+} standin_event_t;
+
+uint32_t standin_events_fired(void) {
+    return __atomic_load_n(&sglobals.events_fired, __ATOMIC_RELAXED);
+}
+
+switch_status_t switch_event_reserve_subclass_detailed(const char *owner, const char *subclass_name) {
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_free_subclass_detailed(const char *owner, const char *subclass_name) {
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_create_subclass_detailed(const char *file, const char *func, int line, switch_event_t **event, switch_event_types_t event_id, const char *subclass_name) {
+    standin_event_t *ev = calloc(1, sizeof(standin_event_t));
+
+    if(!ev) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    ev->subclass = strdup(subclass_name ? subclass_name : "");
+    *event = (switch_event_t *)ev;
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_add_header_string(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *data) {
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *fmt, ...) {
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t switch_event_add_body(switch_event_t *event, const char *fmt, ...) {
+    standin_event_t *ev = (standin_event_t *)event;
+    va_list ap;
+    int len = 0;
+
+    va_start(ap, fmt);
+    len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    free(ev->body);
+    if(len < 0 || !(ev->body = malloc(len + 1))) {
+        ev->body = NULL;
+        return SWITCH_STATUS_MEMERR;
+    }
+    va_start(ap, fmt);
+    vsnprintf(ev->body, len + 1, fmt, ap);
+    va_end(ap);
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_event_destroy(switch_event_t **event) {
+    standin_event_t *ev = (event ? (standin_event_t *)*event : NULL);
+
+    if(ev) {
+        free(ev->subclass);
+        free(ev->body);
+        free(ev);
+        *event = NULL;
+    }
+}
+
+switch_status_t switch_event_fire_detailed(const char *file, const char *func, int line, switch_event_t **event, void *user_data) {
+    standin_event_t *ev = (standin_event_t *)*event;
+
+    __atomic_add_fetch(&sglobals.events_fired, 1, __ATOMIC_RELAXED);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "event %s: %s\n", ev->subclass, (ev->body ? ev->body : ""));
+    switch_event_destroy(event);
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// cJSON (the subset used by the module)
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+typedef struct {
+    char                    *data;
+    size_t                  len;
+    size_t                  size;
+} json_out_t;
+
+static cJSON *json_new(int type) {
+    cJSON *item = calloc(1, sizeof(cJSON));
+    if(item) { item->type = type; }
+    return item;
+}
+
+cJSON *cJSON_CreateObject(void) {
+    return json_new(cJSON_Object);
+}
+
+cJSON *cJSON_CreateArray(void) {
+    return json_new(cJSON_Array);
+}
+
+cJSON *cJSON_CreateNumber(double num) {
+    cJSON *item = json_new(cJSON_Number);
+    if(item) { item->valuedouble = num; item->valueint = (int)num; }
+    return item;
+}
+
+cJSON *cJSON_CreateString(const char *string) {
+    cJSON *item = json_new(cJSON_String);
+    if(item) { item->valuestring = strdup(string ? string : ""); }
+    return item;
+}
+
+cJSON *cJSON_CreateBool(cJSON_bool boolean) {
+    return json_new(boolean ? cJSON_True : cJSON_False);
+}
+
+cJSON_bool cJSON_AddItemToArray(cJSON *array, cJSON *item) {
+    cJSON *c = NULL;
+
+    if(!array || !item) {
+        return 0;
+    }
+    if(!(c = array->child)) {
+        array->child = item;
+    } else {
+        while(c->next) { c = c->next; }
+        c->next = item;
+        item->prev = c;
+    }
+    return 1;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item) {
+    if(!item) {
+        return 0;
+    }
+    item->string = strdup(string);
+    return cJSON_AddItemToArray(object, item);
+}
+
+cJSON *cJSON_AddNumberToObject(cJSON * const object, const char * const name, const double number) {
+    cJSON *item = cJSON_CreateNumber(number);
+    return (cJSON_AddItemToObject(object, name, item) ? item : NULL);
+}
+
+cJSON *cJSON_AddStringToObject(cJSON * const object, const char * const name, const char * const string) {
+    cJSON *item = cJSON_CreateString(string);
+    return (cJSON_AddItemToObject(object, name, item) ? item : NULL);
+}
+
+cJSON *cJSON_AddBoolToObject(cJSON * const object, const char * const name, const cJSON_bool boolean) {
+    cJSON *item = cJSON_CreateBool(boolean);
+    return (cJSON_AddItemToObject(object, name, item) ? item : NULL);
+}
+
+void cJSON_Delete(cJSON *item) {
+    while(item) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+static void json_puts(json_out_t *out, const char *s, size_t len) {
+    if(out->len + len + 1 > out->size) {
+        size_t size = MAX(out->size * 2, out->len + len + 256);
+        char *tmp = realloc(out->data, size);
+        if(!tmp) { return; }
+        out->data = tmp;
+        out->size = size;
+    }
+    memcpy(out->data + out->len, s, len);
+    out->len += len;
+    out->data[out->len] = '\0';
+}
+
+static void json_put_string(json_out_t *out, const char *s) {
+    json_puts(out, "\"", 1);
+    for(; s && *s; s++) {
+        char esc[8];
+        if(*s == '"' || *s == '\\') {
+            esc[0] = '\\'; esc[1] = *s;
+            json_puts(out, esc, 2);
+        } else if((unsigned char)*s < 0x20) {
+            json_puts(out, esc, snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)*s));
+        } else {
+            json_puts(out, s, 1);
+        }
+    }
+    json_puts(out, "\"", 1);
+}
+
+static void json_print(json_out_t *out, const cJSON *item) {
+    char tmp[64];
+
+    switch(item->type & 0xff) {
+        case cJSON_False: json_puts(out, "false", 5); break;
+        case cJSON_True: json_puts(out, "true", 4); break;
+        case cJSON_NULL: json_puts(out, "null", 4); break;
+        case cJSON_Number:
+            if(item->valuedouble == (double)(int64_t)item->valuedouble && fabs(item->valuedouble) < 1e15) {
+                json_puts(out, tmp, snprintf(tmp, sizeof(tmp), "%"PRId64, (int64_t)item->valuedouble));
+            } else {
+                json_puts(out, tmp, snprintf(tmp, sizeof(tmp), "%.6g", item->valuedouble));
+            }
+            break;
+        case cJSON_String: json_put_string(out, item->valuestring); break;
+        case cJSON_Array:
+        case cJSON_Object: {
+            uint8_t fl_object = ((item->type & 0xff) == cJSON_Object);
+            json_puts(out, (fl_object ? "{" : "["), 1);
+            for(const cJSON *c = item->child; c; c = c->next) {
+                if(c != item->child) { json_puts(out, ",", 1); }
+                if(fl_object) {
+                    json_put_string(out, c->string);
+                    json_puts(out, ":", 1);
+                }
+                json_print(out, c);
+            }
+            json_puts(out, (fl_object ? "}" : "]"), 1);
+            break;
+        }
+    }
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item) {
+    json_out_t out = { 0 };
+
+    if(item) {
+        json_print(&out, item);
+    }
+    return out.data;
+}
+
+char *cJSON_Print(const cJSON *item) {
+    return cJSON_PrintUnformatted(item);
+}
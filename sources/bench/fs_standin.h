@@ -0,0 +1,35 @@
+/*
+ * Thin stand-in for the parts of the FreeSWITCH core used by the module (pools, mutexes, queues, buffers,
+ * threads, vad, xml config, logging, api/asr interfaces), so it can be driven outside of a running switch.
+ * Compiled against the real switch headers, linked instead of libfreeswitch.
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ */
+#ifndef FS_STANDIN_H
+#define FS_STANDIN_H
+
+#include <switch.h>
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+/* config file served by switch_xml_open_cfg() (any name), log level for switch_log_printf() */
+void standin_init(const char *config_path, switch_log_level_t log_level);
+
+/* interfaces created by the module load function */
+switch_asr_interface_t *standin_asr_interface(const char *name);
+switch_api_interface_t *standin_api_interface(const char *name);
+
+/* runs an api command and prints its output to stdout */
+switch_status_t standin_api_execute(const char *name, const char *cmd);
+
+/* events fired by the module so far (their bodies are logged at debug) */
+uint32_t standin_events_fired(void);
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Micro-benchmark for the audio conversion kernels (utils.c)
+ * compares the legacy path (int16 resample -> int16 buffer -> per-sample i2f)
+ * with the vectorized i2f and the fused resample_to_float on 15 sec chunks.
+ *
+ * usage: whisper_asr_kernels_bench [iterations]
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ */
+#include "mod_whisper_asr.h"
+#include <math.h>
+#include <time.h>
+
+#define CHUNK_SEC   15
+
+static double time_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+static void legacy_i2f(int16_t *in, float *out, uint32_t samples) {
+    for(uint32_t i = 0; i < samples; i++) {
+        out[i] = (float) ((in[i] > 0) ? (in[i] / 32767.0) : (in[i] / 32768.0));
+    }
+}
+
+static void make_signal(int16_t *buf, uint32_t samples, uint32_t samplerate) {
+    for(uint32_t i = 0; i < samples; i++) {
+        double t = (double)i / samplerate;
+        double v = 0.4 * sin(2 * M_PI * 220 * t) + 0.2 * sin(2 * M_PI * 1250 * t) + 0.05 * ((rand() % 2000) / 1000.0 - 1.0);
+        buf[i] = (int16_t)(v * 32767);
+    }
+}
+
+static void bench_rate(uint32_t samplerate, uint32_t iterations) {
+    uint32_t in_smps = samplerate * CHUNK_SEC;
+    uint32_t out_max = (WHISPER_SAMPLE_RATE * CHUNK_SEC) + RESAMPLE_BLOCK_SIZE;
+    int16_t *in = malloc(in_smps * sizeof(int16_t));
+    int16_t *rsmp = malloc(out_max * sizeof(int16_t));
+    float *out_old = malloc(out_max * sizeof(float));
+    float *out_new = malloc(out_max * sizeof(float));
+    SpeexResamplerState *rs_old = NULL, *rs_new = NULL;
+    double t0 = 0, t_old = 0, t_new = 0, max_diff = 0;
+    uint32_t n_old = 0, n_new = 0;
+    int err = 0;
+
+    make_signal(in, in_smps, samplerate);
+
+    if(samplerate == WHISPER_SAMPLE_RATE) {
+        t0 = time_ms();
+        for(uint32_t i = 0; i < iterations; i++) { legacy_i2f(in, out_old, in_smps); }
+        t_old = time_ms() - t0;
+
+        t0 = time_ms();
+        for(uint32_t i = 0; i < iterations; i++) { i2f(in, out_new, in_smps); }
+        t_new = time_ms() - t0;
+
+        n_old = n_new = in_smps;
+    } else {
+        rs_old = speex_resampler_init(1, samplerate, WHISPER_SAMPLE_RATE, SWITCH_RESAMPLE_QUALITY, &err);
+        rs_new = speex_resampler_init(1, samplerate, WHISPER_SAMPLE_RATE, SWITCH_RESAMPLE_QUALITY, &err);
+
+        t0 = time_ms();
+        for(uint32_t i = 0; i < iterations; i++) {
+            spx_uint32_t ilen = in_smps, olen = out_max;
+            speex_resampler_reset_mem(rs_old);
+            speex_resampler_process_interleaved_int(rs_old, in, &ilen, rsmp, &olen);
+            legacy_i2f(rsmp, out_old, olen);
+            n_old = olen;
+        }
+        t_old = time_ms() - t0;
+
+        t0 = time_ms();
+        for(uint32_t i = 0; i < iterations; i++) {
+            speex_resampler_reset_mem(rs_new);
+            n_new = resample_to_float(rs_new, in, in_smps, out_new, out_max);
+        }
+        t_new = time_ms() - t0;
+
+        speex_resampler_destroy(rs_old);
+        speex_resampler_destroy(rs_new);
+    }
+
+    for(uint32_t i = 0; i < MIN(n_old, n_new); i++) {
+        double d = fabs(out_old[i] - out_new[i]);
+        if(d > max_diff) { max_diff = d; }
+    }
+
+    printf("%5u Hz -> %u Hz: legacy %8.3f ms/chunk, new %8.3f ms/chunk, speedup x%.2f (samples %u/%u, max diff %.6f)\n",
+        samplerate, WHISPER_SAMPLE_RATE, t_old / iterations, t_new / iterations, (t_new > 0 ? t_old / t_new : 0), n_old, n_new, max_diff);
+
+    free(in); free(rsmp); free(out_old); free(out_new);
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = (argc > 1 ? atoi(argv[1]) : 50);
+
+#if defined(__AVX2__)
+    printf("kernels: AVX2\n");
+#elif defined(__SSE2__)
+    printf("kernels: SSE2\n");
+#else
+    printf("kernels: scalar\n");
+#endif
+
+    bench_rate(8000, iterations);
+    bench_rate(16000, iterations);
+    bench_rate(48000, iterations);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Minimal WAV reader for the benchmark tools (PCM 16 bit, the first channel is taken)
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "wavfile.h"
+
+static uint32_t le32(const uint8_t *p) { return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24)); }
+static uint16_t le16(const uint8_t *p) { return (p[0] | (p[1] << 8)); }
+
+int wavfile_load(const char *path, wavfile_t *wav) {
+    uint8_t hdr[12], chunk[8], fmt[16];
+    uint16_t channels = 0, bits = 0;
+    FILE *fp = NULL;
+    int status = -1;
+
+    memset(wav, 0, sizeof(*wav));
+
+    if((fp = fopen(path, "rb")) == NULL) {
+        return -1;
+    }
+    if(fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+        goto out;
+    }
+
+    while(fread(chunk, 1, sizeof(chunk), fp) == sizeof(chunk)) {
+        uint32_t len = le32(chunk + 4);
+
+        if(!memcmp(chunk, "fmt ", 4)) {
+            if(len < sizeof(fmt) || fread(fmt, 1, sizeof(fmt), fp) != sizeof(fmt)) {
+                goto out;
+            }
+            if(le16(fmt) != 1) { // PCM only
+                goto out;
+            }
+            channels = le16(fmt + 2);
+            wav->samplerate = le32(fmt + 4);
+            bits = le16(fmt + 14);
+            fseek(fp, (len - sizeof(fmt)) + (len & 1), SEEK_CUR);
+        } else if(!memcmp(chunk, "data", 4)) {
+            int16_t *raw = NULL;
+            uint32_t frames = 0;
+
+            if(!channels || bits != 16) {
+                goto out;
+            }
+            frames = len / (channels * sizeof(int16_t));
+            if((raw = malloc(len)) == NULL) {
+                goto out;
+            }
+            frames = fread(raw, channels * sizeof(int16_t), frames, fp);
+
+            if((wav->samples = malloc(frames * sizeof(int16_t))) == NULL) {
+                free(raw);
+                goto out;
+            }
+            for(uint32_t i = 0; i < frames; i++) {
+                wav->samples[i] = raw[i * channels];
+            }
+            wav->nsamples = frames;
+            free(raw);
+
+            status = 0;
+            break;
+        } else {
+            fseek(fp, len + (len & 1), SEEK_CUR);
+        }
+    }
+out:
+    fclose(fp);
+    if(status == 0) {
+        const char *p = strrchr(path, '/');
+        wav->name = strdup(p ? p + 1 : path);
+    }
+    return status;
+}
+
+void wavfile_free(wavfile_t *wav) {
+    if(wav) {
+        free(wav->samples);
+        free(wav->name);
+        memset(wav, 0, sizeof(*wav));
+    }
+}
+
+int wavfile_load_list(const char *path, wavfile_t **list) {
+    struct stat st;
+    struct dirent *de = NULL;
+    wavfile_t *files = NULL;
+    DIR *dir = NULL;
+    int count = 0;
+
+    *list = NULL;
+
+    if(stat(path, &st) != 0) {
+        return 0;
+    }
+    if(!S_ISDIR(st.st_mode)) {
+        if((files = calloc(1, sizeof(wavfile_t))) && wavfile_load(path, files) == 0) {
+            *list = files;
+            return 1;
+        }
+        free(files);
+        return 0;
+    }
+
+    if((dir = opendir(path)) == NULL) {
+        return 0;
+    }
+    while((de = readdir(dir)) != NULL) {
+        size_t nlen = strlen(de->d_name);
+        char fname[4096];
+        wavfile_t *tmp = NULL;
+
+        if(nlen < 5 || strcasecmp(de->d_name + nlen - 4, ".wav")) {
+            continue;
+        }
+        if((tmp = realloc(files, (count + 1) * sizeof(wavfile_t))) == NULL) {
+            break;
+        }
+        files = tmp;
+
+        snprintf(fname, sizeof(fname), "%s/%s", path, de->d_name);
+        if(wavfile_load(fname, &files[count]) == 0) {
+            count++;
+        } else {
+            fprintf(stderr, "Skipping: %s (not a PCM16 wav)\n", fname);
+        }
+    }
+    closedir(dir);
+
+    *list = files;
+    return count;
+}
+
+void wavfile_free_list(wavfile_t *list, int count) {
+    for(int i = 0; i < count; i++) {
+        wavfile_free(&list[i]);
+    }
+    free(list);
+}
@@ -0,0 +1,27 @@
+/*
+ * Minimal WAV reader for the benchmark tools (PCM 16 bit, the first channel is taken)
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ */
+#ifndef WAVFILE_H
+#define WAVFILE_H
+
+#include <stdint.h>
+
+typedef struct {
+    char                    *name;
+    int16_t                 *samples;
+    uint32_t                nsamples;
+    uint32_t                samplerate;
+} wavfile_t;
+
+int wavfile_load(const char *path, wavfile_t *wav);
+void wavfile_free(wavfile_t *wav);
+
+/* loads all *.wav from a directory (or a single file), returns the number of loaded files */
+int wavfile_load_list(const char *path, wavfile_t **list);
+void wavfile_free_list(wavfile_t *list, int count);
+
+#endif
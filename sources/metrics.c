@@ -0,0 +1,187 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ *
+ */
+#include "mod_whisper_asr.h"
+
+static const char *stage_names[METRICS_STAGE_MAX] = {
+    "queue", "convert", "vad", "encode", "decode", "inference", "total"
+};
+
+void metrics_init(metrics_t *metrics) {
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->started = switch_micro_time_now();
+}
+
+void metrics_add(uint64_t *counter, uint64_t val) {
+    __atomic_fetch_add(counter, val, __ATOMIC_RELAXED);
+}
+
+/* share of the batch slots that were used, 1.0 = every run was full */
+double metrics_batch_fill(metrics_t *metrics, uint32_t batch_max_size) {
+    uint64_t runs = __atomic_load_n(&metrics->batch_runs, __ATOMIC_RELAXED);
+    uint64_t jobs = __atomic_load_n(&metrics->batch_jobs, __ATOMIC_RELAXED);
+
+    return ((runs && batch_max_size) ? ((double)jobs / (double)(runs * batch_max_size)) : 0.0);
+}
+
+/* writers only do relaxed atomic adds, readers may see a histogram that is a few samples ahead of its count */
+void metrics_hist_add(metrics_hist_t *hist, uint64_t usec) {
+    uint32_t idx = (usec ? (64 - __builtin_clzll(usec)) : 0);
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+    if(idx >= METRICS_HIST_BUCKETS) {
+        idx = METRICS_HIST_BUCKETS - 1;
+    }
+
+    __atomic_fetch_add(&hist->buckets[idx], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->sum, usec, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+
+    while(usec > max) {
+        if(__atomic_compare_exchange_n(&hist->max, &max, usec, SWITCH_TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+/* upper bound of the bucket holding the p-th value (0..1), clamped to the observed max */
+uint64_t metrics_hist_percentile(metrics_hist_t *hist, double p) {
+    uint64_t count = 0, target = 0, acc = 0;
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+
+    for(uint32_t i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        count += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+    }
+    if(!count) {
+        return 0;
+    }
+
+    target = (uint64_t)(p * count);
+    target = (target ? target : 1);
+
+    for(uint32_t i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        acc += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        if(acc >= target) {
+            return MIN((i ? (1ULL << i) : 0), max);
+        }
+    }
+
+    return max;
+}
+
+const char *metrics_stage_name(metrics_stage_t stage) {
+    return (stage < METRICS_STAGE_MAX ? stage_names[stage] : "unknown");
+}
+
+void metrics_print_stages(metrics_t *metrics, switch_stream_handle_t *stream) {
+    stream->write_function(stream, "%-10s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "avg_ms", "p50_ms", "p95_ms", "p99_ms", "max_ms");
+
+    for(uint32_t i = 0; i < METRICS_STAGE_MAX; i++) {
+        metrics_hist_t *hist = &metrics->stages[i];
+        uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+        uint64_t sum = __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+
+        stream->write_function(stream, "%-10s %10"SWITCH_UINT64_T_FMT" %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            stage_names[i], count,
+            (count ? ((double)sum / count / 1000.0) : 0.0),
+            (metrics_hist_percentile(hist, 0.50) / 1000.0),
+            (metrics_hist_percentile(hist, 0.95) / 1000.0),
+            (metrics_hist_percentile(hist, 0.99) / 1000.0),
+            (__atomic_load_n(&hist->max, __ATOMIC_RELAXED) / 1000.0)
+        );
+    }
+}
+
+cJSON *metrics_stages_json(metrics_t *metrics) {
+    cJSON *jstages = cJSON_CreateObject();
+
+    for(uint32_t i = 0; i < METRICS_STAGE_MAX; i++) {
+        metrics_hist_t *hist = &metrics->stages[i];
+        uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+        uint64_t sum = __atomic_load_n(&hist->sum, __ATOMIC_RELAXED);
+        cJSON *jstage = cJSON_CreateObject();
+        cJSON *jbuckets = cJSON_CreateArray();
+
+        cJSON_AddNumberToObject(jstage, "count", count);
+        cJSON_AddNumberToObject(jstage, "avg_us", (count ? ((double)sum / count) : 0.0));
+        cJSON_AddNumberToObject(jstage, "p50_us", metrics_hist_percentile(hist, 0.50));
+        cJSON_AddNumberToObject(jstage, "p95_us", metrics_hist_percentile(hist, 0.95));
+        cJSON_AddNumberToObject(jstage, "p99_us", metrics_hist_percentile(hist, 0.99));
+        cJSON_AddNumberToObject(jstage, "max_us", __atomic_load_n(&hist->max, __ATOMIC_RELAXED));
+
+        for(uint32_t b = 0; b < METRICS_HIST_BUCKETS; b++) {
+            cJSON_AddItemToArray(jbuckets, cJSON_CreateNumber(__atomic_load_n(&hist->buckets[b], __ATOMIC_RELAXED)));
+        }
+        cJSON_AddItemToObject(jstage, "buckets", jbuckets);
+
+        cJSON_AddItemToObject(jstages, stage_names[i], jstage);
+    }
+
+    return jstages;
+}
+
+void metrics_threads_add(metrics_t *metrics, uint32_t n_threads, uint8_t fl_clamped) {
+    __atomic_fetch_add(&metrics->threads_granted[MIN(n_threads, METRICS_THREAD_SLOTS - 1)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metrics->threads_sum, n_threads, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metrics->threads_grants, 1, __ATOMIC_RELAXED);
+    if(fl_clamped) {
+        __atomic_fetch_add(&metrics->threads_clamped, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_print_threads(metrics_t *metrics, switch_stream_handle_t *stream) {
+    uint64_t grants = __atomic_load_n(&metrics->threads_grants, __ATOMIC_RELAXED);
+    uint64_t sum = __atomic_load_n(&metrics->threads_sum, __ATOMIC_RELAXED);
+
+    stream->write_function(stream, "threads: avg=%.1f, clamped=%"SWITCH_UINT64_T_FMT", waited=%"SWITCH_UINT64_T_FMT",",
+        (grants ? ((double)sum / grants) : 0.0), metrics->threads_clamped, metrics->threads_waited);
+    for(uint32_t i = 0; i < METRICS_THREAD_SLOTS; i++) {
+        uint64_t count = __atomic_load_n(&metrics->threads_granted[i], __ATOMIC_RELAXED);
+        if(count) {
+            stream->write_function(stream, " %u%s=%"SWITCH_UINT64_T_FMT, i, (i == METRICS_THREAD_SLOTS - 1 ? "+" : ""), count);
+        }
+    }
+    stream->write_function(stream, "\n");
+}
+
+cJSON *metrics_threads_json(metrics_t *metrics) {
+    cJSON *jthreads = cJSON_CreateObject();
+    cJSON *jgranted = cJSON_CreateObject();
+    uint64_t grants = __atomic_load_n(&metrics->threads_grants, __ATOMIC_RELAXED);
+    uint64_t sum = __atomic_load_n(&metrics->threads_sum, __ATOMIC_RELAXED);
+    char name[16];
+
+    cJSON_AddNumberToObject(jthreads, "grants", grants);
+    cJSON_AddNumberToObject(jthreads, "avg", (grants ? ((double)sum / grants) : 0.0));
+    cJSON_AddNumberToObject(jthreads, "clamped", __atomic_load_n(&metrics->threads_clamped, __ATOMIC_RELAXED));
+    cJSON_AddNumberToObject(jthreads, "waited", __atomic_load_n(&metrics->threads_waited, __ATOMIC_RELAXED));
+
+    for(uint32_t i = 0; i < METRICS_THREAD_SLOTS; i++) {
+        uint64_t count = __atomic_load_n(&metrics->threads_granted[i], __ATOMIC_RELAXED);
+        if(count) {
+            snprintf(name, sizeof(name), "%u", i);
+            cJSON_AddNumberToObject(jgranted, name, count);
+        }
+    }
+    cJSON_AddItemToObject(jthreads, "granted", jgranted);
+
+    return jthreads;
+}
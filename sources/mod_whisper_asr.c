@@ -28,132 +28,828 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_whisper_asr_shutdown);
 SWITCH_MODULE_DEFINITION(mod_whisper_asr, mod_whisper_asr_load, mod_whisper_asr_shutdown, NULL);
 
 
-static void *SWITCH_THREAD_FUNC whisper_transcribe_thread(switch_thread_t *thread, void *obj) {
-    volatile wasr_ctx_t *_ref = (wasr_ctx_t *) obj;
-    wasr_ctx_t *asr_ctx = (wasr_ctx_t *) _ref;
-    switch_memory_pool_t *pool = NULL;
-    switch_byte_t *chunk_bufferfer = NULL;
-    switch_buffer_t *text_buffer = NULL;
-    switch_byte_t *rsmp_buffer = NULL;
-    switch_byte_t *float_buffer = NULL;
-    uint32_t rsmp_buffer_size = 0, float_buffer_size = 0;
-    uint32_t chunk_buffer_offset = 0, chunk_buffer_size = 0;
-    uint8_t fl_transcribe = SWITCH_FALSE;
-    void *pop = NULL;
+static uint8_t asr_ctx_chunk_ready(wasr_ctx_t *asr_ctx) {
+    uint32_t used = audio_ring_used(&asr_ctx->audio_ring);
+
+    if(!asr_ctx->chunk_samples || !used) {
+        return SWITCH_FALSE;
+    }
+    return (used >= asr_ctx->chunk_samples || asr_ctx->fl_flush);
+}
+
+static uint8_t asr_ctx_job_ready(wasr_ctx_t *asr_ctx) {
+    return (asr_ctx_chunk_ready(asr_ctx) || (asr_ctx->fl_partial_req && audio_ring_used(&asr_ctx->audio_ring) > 0));
+}
+
+/*
+ * queue order: arrival time, pushed back by the amount of audio waiting (shortest job first) up to sched-max-age-ms
+ * so that long chunks can't starve, pulled forward by the call priority and bounded by the call deadline.
+ */
+static int64_t asr_ctx_job_key(wasr_ctx_t *asr_ctx) {
+    int64_t now = switch_micro_time_now();
+    int64_t key = now, cost_ms = 0;
+    uint32_t used = 0;
+
+    if(!globals.fl_sched_sjf) {
+        return now;
+    }
+
+    used = MIN(audio_ring_used(&asr_ctx->audio_ring), asr_ctx->chunk_samples);
+    cost_ms = ((int64_t)used * 1000 / asr_ctx->samplerate);
+
+    key += MIN(cost_ms * globals.sched_cost_weight, (int64_t)globals.sched_max_age_ms * 1000);
+    key -= ((int64_t)asr_ctx->priority * globals.sched_prio_step_ms * 1000);
+
+    if(asr_ctx->deadline_ms) {
+        key = MIN(key, now + ((int64_t)asr_ctx->deadline_ms * 1000));
+    }
+
+    return key;
+}
+
+/* the audio waiting in the ring goes to the node backlog as a delta, both the media thread and the worker update it */
+static void asr_ctx_backlog_update(wasr_ctx_t *asr_ctx) {
+    int64_t us = (asr_ctx->audio_ring.data ? ((int64_t)audio_ring_used(&asr_ctx->audio_ring) * 1000000 / asr_ctx->samplerate) : 0);
+    int64_t prev = __atomic_exchange_n(&asr_ctx->backlog_us, us, __ATOMIC_ACQ_REL);
+
+    if(us != prev) {
+        __atomic_add_fetch(&globals.backlog_us, (us - prev), __ATOMIC_RELAXED);
+    }
+}
+
+static uint8_t load_over(uint64_t val, uint32_t mark, uint32_t pct) {
+    return (mark && (val * 100) >= ((uint64_t)mark * pct));
+}
+
+static const char *load_state_name(load_state_t state) {
+    return (state == LOAD_STATE_OVERLOADED ? "overloaded" : (state == LOAD_STATE_DEGRADED ? "degraded" : "normal"));
+}
+
+/*
+ * node load from the backlog, the queue depth and the smoothed queue wait (only while jobs wait).
+ * a state is entered at its watermarks and left under LOAD_RELEASE_PCT of them.
+ */
+static load_state_t load_state(void) {
+    uint64_t backlog_ms = (uint64_t)MAX(__atomic_load_n(&globals.backlog_us, __ATOMIC_RELAXED), 0) / 1000;
+    uint32_t depth = jobs_queue_size(globals.q_jobs);
+    uint64_t wait_ms = (depth ? (__atomic_load_n(&globals.queue_wait_us, __ATOMIC_RELAXED) / 1000) : 0);
+    load_state_t cur = __atomic_load_n(&globals.load_state, __ATOMIC_RELAXED), next = LOAD_STATE_NORMAL;
+    uint32_t pct = (cur == LOAD_STATE_OVERLOADED ? LOAD_RELEASE_PCT : 100);
+
+    if(load_over(backlog_ms, globals.admit_max_backlog_ms, pct) || load_over(depth, globals.admit_max_queue, pct) || load_over(wait_ms, globals.admit_max_wait_ms, pct)) {
+        next = LOAD_STATE_OVERLOADED;
+    } else if(load_over(backlog_ms, globals.degrade_backlog_ms, (cur >= LOAD_STATE_DEGRADED ? LOAD_RELEASE_PCT : 100))) {
+        next = LOAD_STATE_DEGRADED;
+    }
+
+    if(next != cur && __atomic_exchange_n(&globals.load_state, next, __ATOMIC_RELAXED) != next) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, (next > cur ? SWITCH_LOG_WARNING : SWITCH_LOG_NOTICE), "Load %s -> %s (backlog=%"SWITCH_UINT64_T_FMT" ms, queue=%u, wait=%"SWITCH_UINT64_T_FMT" ms)\n",
+            load_state_name(cur), load_state_name(next), backlog_ms, depth, wait_ms);
+    }
+
+    return next;
+}
+
+/* must be called with asr_ctx->mutex locked */
+static void asr_ctx_submit(wasr_ctx_t *asr_ctx) {
+    if(asr_ctx->fl_job_queued || asr_ctx->fl_destroyed || globals.fl_shutdown || !asr_ctx_job_ready(asr_ctx)) {
+        return;
+    }
+    if(!asr_ctx_take(asr_ctx)) {
+        return;
+    }
+    asr_ctx->queued_ts = switch_micro_time_now();
+    if(jobs_queue_push(globals.q_jobs, asr_ctx, asr_ctx_job_key(asr_ctx)) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Jobs queue is full\n");
+        metrics_add(&globals.metrics.jobs_rejected, 1);
+        asr_ctx_release(asr_ctx);
+        return;
+    }
+    asr_ctx->fl_job_queued = SWITCH_TRUE;
+}
+
+/* drops the audio buffered up to the pause, must be called with asr_ctx->mutex locked by the ring consumer (not queued or the worker holding it) */
+static void asr_ctx_discard(wasr_ctx_t *asr_ctx) {
+    audio_ring_t *ring = &asr_ctx->audio_ring;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    int32_t smps = (int32_t)(asr_ctx->discard_head - tail);
+
+    if(ring->data && smps > 0) {
+        audio_ring_consume(ring, smps);
+        if(!asr_ctx->fl_abort) { metrics_add(&globals.metrics.discarded_smps, smps); }
+        asr_ctx_backlog_update(asr_ctx);
+    }
+    if(!ring->data || !audio_ring_used(ring)) {
+        asr_ctx->fl_flush = SWITCH_FALSE;
+        asr_ctx->flush_ts = 0;
+    }
+    __atomic_store_n(&asr_ctx->fl_partial_reset, SWITCH_TRUE, __ATOMIC_RELEASE);
+    asr_ctx->fl_partial_req = SWITCH_FALSE;
+    asr_ctx->fl_discard = SWITCH_FALSE;
+}
+
+/*
+ * hangup/pause-discard: the queued job is taken back, a running one stops at the next abort callback
+ * and its result is thrown away. must be called with asr_ctx->mutex locked, asr_ctx_cancel_remote() follows it unlocked.
+ */
+static void asr_ctx_cancel(wasr_ctx_t *asr_ctx) {
+    __atomic_add_fetch(&asr_ctx->cancel_gen, 1, __ATOMIC_RELEASE);
+    asr_ctx->discard_head = __atomic_load_n(&asr_ctx->audio_ring.head, __ATOMIC_ACQUIRE);
+    asr_ctx->fl_discard = SWITCH_TRUE;
+
+    if(asr_ctx->fl_job_queued && jobs_queue_remove(globals.q_jobs, asr_ctx) == SWITCH_STATUS_SUCCESS) {
+        asr_ctx->fl_job_queued = SWITCH_FALSE;
+        metrics_add(&globals.metrics.jobs_cancelled, 1);
+        asr_ctx_release(asr_ctx);
+    }
+    // otherwise the worker holding the session drops the audio when it is done with it
+    if(!asr_ctx->fl_job_queued) {
+        asr_ctx_discard(asr_ctx);
+    }
+}
+
+/* the remote request of a cancelled session is dropped outside of the session lock (cancel_gen covers one sent meanwhile) */
+static void asr_ctx_cancel_remote(wasr_ctx_t *asr_ctx) {
+    if(globals.fl_remote) {
+        remote_client_cancel(globals.remote, asr_ctx);
+    }
+}
+
+static switch_status_t asr_ctx_push_result(wasr_ctx_t *asr_ctx, const void *data, uint32_t len, uint32_t flags) {
+    xdata_buffer_t *result = NULL;
+
+    if(xdata_buffer_alloc(&result, (switch_byte_t *)data, len) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_FALSE;
+    }
+    result->flags = flags;
+
+    if(switch_queue_trypush(asr_ctx->q_text, result) != SWITCH_STATUS_SUCCESS) {
+        metrics_add(&globals.metrics.results_dropped, 1);
+        xdata_buffer_free(&result);
+        return SWITCH_STATUS_FALSE;
+    }
 
     switch_mutex_lock(asr_ctx->mutex);
-    asr_ctx->refs++;
+    asr_ctx->transcript_results++;
     switch_mutex_unlock(asr_ctx->mutex);
 
-    if(switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "switch_core_new_memory_pool()\n");
-        goto out;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static uint32_t asr_ctx_convert(wasr_ctx_t *asr_ctx, int16_t *p1, uint32_t l1, int16_t *p2, uint32_t l2, float *out, uint32_t out_max) {
+    uint32_t out_smps = 0;
+
+    if(asr_ctx->resampler) {
+        // chunks are transcribed independently, partials also re-read the same audio
+        speex_resampler_reset_mem(asr_ctx->resampler);
+
+        out_smps = resample_to_float(asr_ctx->resampler, p1, l1, out, out_max);
+        if(l2) {
+            out_smps += resample_to_float(asr_ctx->resampler, p2, l2, out + out_smps, out_max - out_smps);
+        }
+    } else {
+        i2f(p1, out, l1);
+        if(l2) { i2f(p2, out + l1, l2); }
+        out_smps = (l1 + l2);
     }
-    if(switch_buffer_create_dynamic(&text_buffer, 1024, 1024, 16384) != SWITCH_STATUS_SUCCESS) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "switch_buffer_create_dynamic()\n");
-        asr_ctx->fl_abort = SWITCH_TRUE;
-        goto out;
+
+    return out_smps;
+}
+
+/* float samples the chunk takes after conversion */
+static uint32_t asr_ctx_float_samples(wasr_ctx_t *asr_ctx, uint32_t in_smps) {
+    if(asr_ctx->resampler) {
+        return ((uint64_t)WHISPER_SAMPLE_RATE * in_smps / asr_ctx->samplerate) + RESAMPLE_BLOCK_SIZE;
+    }
+    return in_smps;
+}
+
+/* returns the session back to the queue if it has more work, otherwise drops the worker's reference */
+static void asr_ctx_requeue(wasr_ctx_t *asr_ctx) {
+    uint8_t fl_requeued = SWITCH_FALSE;
+
+    switch_mutex_lock(asr_ctx->mutex);
+    if(asr_ctx->fl_discard) {
+        asr_ctx_discard(asr_ctx);
+    }
+    if(!globals.fl_shutdown && !asr_ctx->fl_destroyed && !asr_ctx->fl_abort && asr_ctx_job_ready(asr_ctx)) {
+        asr_ctx->queued_ts = switch_micro_time_now();
+        fl_requeued = (jobs_queue_push(globals.q_jobs, asr_ctx, asr_ctx_job_key(asr_ctx)) == SWITCH_STATUS_SUCCESS);
+    }
+    if(!fl_requeued) { asr_ctx->fl_job_queued = SWITCH_FALSE; }
+    switch_mutex_unlock(asr_ctx->mutex);
+
+    if(!fl_requeued) {
+        asr_ctx_release(asr_ctx);
+    }
+}
+
+static uint8_t model_lang_match(const char *langs, const char *lang) {
+    size_t len = strlen(lang);
+
+    for(const char *p = langs; p && *p; p = strchr(p, ',')) {
+        while(*p == ',' || *p == ' ') { p++; }
+        if(!strncasecmp(p, lang, len) && (p[len] == '\0' || p[len] == ',' || p[len] == ' ')) {
+            return SWITCH_TRUE;
+        }
+    }
+    return SWITCH_FALSE;
+}
+
+/* the model= param of the call, else the first model whose rule takes the chunk, else the default one */
+static wasr_model_t *job_route(wasr_job_t *job, wasr_model_set_t *mset) {
+    wasr_ctx_t *asr_ctx = job->asr_ctx;
+    const char *lang = (asr_ctx->lang ? asr_ctx->lang : DEF_LANG);
+    uint32_t duration_ms = (uint32_t)((uint64_t)job->samples * 1000 / WHISPER_SAMPLE_RATE);
+    wasr_model_t *model = NULL;
+
+    if(asr_ctx->model && (model = model_set_lookup(mset, asr_ctx->model))) {
+        metrics_add(&model->forced, 1);
+        return model;
+    }
+
+    for(uint32_t i = 1; i < mset->count && !model; i++) {
+        wasr_model_t *m = &mset->models[i];
+
+        if(!m->max_ms && !m->langs) {
+            continue;
+        }
+        if(m->max_ms && duration_ms > m->max_ms) {
+            continue;
+        }
+        if(m->langs && !model_lang_match(m->langs, lang)) {
+            continue;
+        }
+        model = m;
+    }
+
+    return (model ? model : &mset->models[0]);
+}
+
+static void worker_unbind_models(wasr_worker_t *worker) {
+    for(uint32_t i = 1; i < MODELS_MAX; i++) {
+        if(worker->wstates[i]) {
+            whisper_free_state(worker->wstates[i]);
+            worker->wstates[i] = NULL;
+        }
+    }
+    model_set_release(worker->mset);
+    worker->mset = NULL;
+}
+
+/* the other models run on the worker's states, so their memory goes with the workers and not with the calls */
+static void worker_bind_models(wasr_worker_t *worker, wasr_model_set_t *mset) {
+    worker_unbind_models(worker);
+
+    model_set_ref(mset);
+    worker->mset = mset;
+    for(uint32_t i = 1; i < mset->count; i++) {
+        if(mset->models[i].wctx && (worker->wstates[i] = whisper_init_state(mset->models[i].wctx)) == NULL) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "whisper_init_state(%s)\n", mset->models[i].name);
+        }
+    }
+}
+
+/* the session's own state for the default model, the worker's one for the others */
+static void job_bind_model(wasr_worker_t *worker, wasr_job_t *job) {
+    wasr_model_set_t *mset = job->asr_ctx->res->mset;
+    wasr_model_t *model = job->model;
+
+    job->wctx = model->wctx;
+    if(model == &mset->models[0]) {
+        job->wstate = job->asr_ctx->res->wstate;
+        return;
+    }
+    if(worker->mset != mset) {
+        worker_bind_models(worker, mset);
+    }
+    job->wstate = worker->wstates[model - mset->models];
+}
+
+/* per model threads, unless the cpu governor shares the cores */
+static uint32_t model_threads_acquire(wasr_model_t *model) {
+    if(!globals.cpu_budget && model->n_threads) {
+        metrics_threads_add(&globals.metrics, model->n_threads, SWITCH_FALSE);
+        return model->n_threads;
+    }
+    return cpu_governor_acquire(&globals);
+}
+
+static void model_account(wasr_model_t *model, uint32_t samples, switch_time_t started) {
+    metrics_add(&model->audio_us, ((uint64_t)samples * 1000000 / WHISPER_SAMPLE_RATE));
+    metrics_add(&model->inference_us, (switch_micro_time_now() - started));
+}
+
+/* speech span of the chunk by the worker's neural vad, a chunk with no speech is left with 0 samples and skipped */
+static void job_vad_gate(wasr_worker_t *worker, wasr_job_t *job) {
+    switch_time_t started = switch_micro_time_now();
+    uint32_t samples = 0, ofs = 0;
+
+    samples = vad_gate(worker->vctx, job->audio, job->samples, globals.vad_gate_threshold, globals.vad_gate_min_speech_ms, globals.trim_pad_ms, &ofs);
+
+    if(!samples) {
+        metrics_add(&globals.metrics.vad_gated, 1);
+        metrics_add(&globals.metrics.vad_skipped_us, ((uint64_t)job->samples * 1000000 / WHISPER_SAMPLE_RATE));
+    } else {
+        metrics_add(&globals.metrics.vad_trimmed_us, ((uint64_t)(job->samples - samples) * 1000000 / WHISPER_SAMPLE_RATE));
+    }
+    metrics_hist_add(&globals.metrics.stages[METRICS_STAGE_VAD], (switch_micro_time_now() - started));
+
+    job->audio += ofs;
+    job->samples = samples;
+}
+
+/* takes the next chunk (final or partial) of the session and converts it into a float buffer of the job */
+static uint8_t job_prepare(wasr_worker_t *worker, wasr_ctx_t *asr_ctx, wasr_job_t *job) {
+    wasr_model_set_t *mset = NULL;
+    uint8_t fl_final = SWITCH_FALSE, fl_partial = SWITCH_FALSE;
+
+    job->queue_us = 0;
+    job->inference_us = 0;
+    if(asr_ctx->queued_ts) {
+        uint64_t wait_us = (switch_micro_time_now() - asr_ctx->queued_ts);
+        uint64_t avg_us = __atomic_load_n(&globals.queue_wait_us, __ATOMIC_RELAXED);
+
+        metrics_hist_add(&globals.metrics.stages[METRICS_STAGE_QUEUE], wait_us);
+        __atomic_store_n(&globals.queue_wait_us, (avg_us - (avg_us >> 3) + (wait_us >> 3)), __ATOMIC_RELAXED);
+        asr_ctx->queued_ts = 0;
+        job->queue_us = wait_us;
     }
 
     while(SWITCH_TRUE) {
-        if(globals.fl_shutdown || asr_ctx->fl_destroyed || asr_ctx->fl_abort) {
-            break;
+        int16_t *p1 = NULL, *p2 = NULL;
+        uint32_t l1 = 0, l2 = 0, in_smps = 0, out_smps = 0, out_max = 0, ofs = 0;
+        switch_time_t started = 0;
+        float *buffer = NULL;
+
+        switch_mutex_lock(asr_ctx->mutex);
+        fl_final = fl_partial = SWITCH_FALSE;
+        if(asr_ctx->fl_discard) {
+            asr_ctx_discard(asr_ctx);
+        }
+        job->cancel_gen = asr_ctx->cancel_gen;
+        if(!globals.fl_shutdown && !asr_ctx->fl_destroyed && !asr_ctx->fl_abort) {
+            fl_final = asr_ctx_chunk_ready(asr_ctx);
+            fl_partial = (!fl_final && asr_ctx_job_ready(asr_ctx));
+        }
+        asr_ctx->fl_partial_req = SWITCH_FALSE;
+        if(!fl_final && !fl_partial) { asr_ctx->fl_job_queued = SWITCH_FALSE; }
+        switch_mutex_unlock(asr_ctx->mutex);
+
+        if(!fl_final && !fl_partial) {
+            return SWITCH_FALSE;
         }
 
-        if(chunk_buffer_size == 0) {
-            switch_mutex_lock(asr_ctx->mutex);
-            chunk_buffer_size = asr_ctx->chunk_buffer_size;
+        if(!(in_smps = audio_ring_peek(&asr_ctx->audio_ring, asr_ctx->chunk_samples, &p1, &l1, &p2, &l2))) {
+            continue;
+        }
 
-            if((chunk_bufferfer = switch_core_alloc(pool, chunk_buffer_size)) == NULL) {
-                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "switch_core_alloc()\n");
-                asr_ctx->fl_abort = SWITCH_TRUE;
+        // sized by the audio in flight rather than by chunk-time-sec
+        started = switch_micro_time_now();
+        out_max = asr_ctx_float_samples(asr_ctx, in_smps);
+        buffer = buf_arena_alloc(globals.arena, out_max * sizeof(float));
+        out_smps = asr_ctx_convert(asr_ctx, p1, l1, p2, l2, buffer, out_max);
+
+        job->flush_ts = 0;
+        job->lang_id = -1;
+        job->lang_p = 0.0f;
+        if(fl_final) {
+            audio_ring_consume(&asr_ctx->audio_ring, in_smps);
+            asr_ctx_backlog_update(asr_ctx);
+
+            switch_mutex_lock(asr_ctx->mutex);
+            if(audio_ring_used(&asr_ctx->audio_ring) == 0) {
+                asr_ctx->fl_flush = SWITCH_FALSE;
+                job->flush_ts = asr_ctx->flush_ts;
+                asr_ctx->flush_ts = 0;
             }
-            if(asr_ctx->resampler) {
-                rsmp_buffer_size = (WHISPER_SAMPLE_RATE * chunk_buffer_size) / asr_ctx->samplerate;
-                float_buffer_size = (rsmp_buffer_size / sizeof(int16_t)) * sizeof(float);
-
-                if((rsmp_buffer = (switch_byte_t *)switch_core_alloc(pool, rsmp_buffer_size)) == NULL) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "switch_core_alloc()\n");
-                    asr_ctx->fl_abort = SWITCH_TRUE;
-                }
-                if((float_buffer = (switch_byte_t *) switch_core_alloc(pool, float_buffer_size)) == NULL) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "switch_core_alloc()\n");
-                    asr_ctx->fl_abort = SWITCH_TRUE;
-                }
-            } else {
-                float_buffer_size = (chunk_buffer_size / sizeof(int16_t)) * sizeof(float);
-                if((float_buffer = (switch_byte_t *) switch_core_alloc(pool, float_buffer_size)) == NULL) {
-                    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "switch_core_alloc()\n");
-                    asr_ctx->fl_abort = SWITCH_TRUE;
-                }
+            __atomic_store_n(&asr_ctx->fl_partial_reset, SWITCH_TRUE, __ATOMIC_RELEASE);
+            switch_mutex_unlock(asr_ctx->mutex);
+        }
+
+        if(asr_ctx->fl_trim_silence) {
+            out_smps = trim_silence(buffer, out_smps, globals.vad_threshold, globals.trim_pad_ms, &ofs);
+        }
+
+        metrics_hist_add(&globals.metrics.stages[METRICS_STAGE_CONVERT], (switch_micro_time_now() - started));
+        metrics_add(&globals.metrics.jobs, 1);
+
+        job->asr_ctx = asr_ctx;
+        job->buffer = buffer;
+        job->audio = buffer + ofs;
+        job->samples = out_smps;
+        job->offset = 0;
+        job->fl_final = fl_final;
+
+        if(worker->vctx && asr_ctx->fl_vad_gate && job->samples) {
+            job_vad_gate(worker, job);
+        }
+
+        // after a reload the session moves to the new models between two chunks
+        if(asr_ctx->res->mset && asr_ctx->res->mset->gen != __atomic_load_n(&globals.mset_gen, __ATOMIC_ACQUIRE)) {
+            sess_res_rebind(asr_ctx->res, &globals);
+        }
+
+        mset = asr_ctx->res->mset;
+        job->model = &mset->models[0];
+        if(mset->count > 1 && job->samples) {
+            job->model = job_route(job, mset);
+        }
+        // a forced model= is left alone
+        if(mset->degrade && job->model != mset->degrade && !asr_ctx->model && job->samples && load_state() >= LOAD_STATE_DEGRADED) {
+            job->model = mset->degrade;
+            metrics_add(&globals.metrics.jobs_degraded, 1);
+        }
+        metrics_add(&job->model->routed, 1);
+
+        return SWITCH_TRUE;
+    }
+}
+
+/*
+ * lang=auto: the call keeps the first language detected with lang-detect-min-p (the remote worker doesn't
+ * send the probability) or the one of the last of lang-detect-max-tries final results, no more detection after that
+ */
+static void job_lang_lock(wasr_job_t *job, const char *lang) {
+    wasr_ctx_t *asr_ctx = job->asr_ctx;
+    switch_core_session_t *session = NULL;
+    uint32_t tries = 0;
+
+    if(zstr(lang) || !strcasecmp(lang, LANG_AUTO)) {
+        return;
+    }
+    if(job->lang_id >= 0) {
+        lang = whisper_lang_str(job->lang_id);
+    }
+
+    // two finals of the call or a {lang=..} may land here at the same time
+    switch_mutex_lock(asr_ctx->mutex);
+    if(!asr_ctx->lang || strcasecmp(asr_ctx->lang, LANG_AUTO)) {
+        switch_mutex_unlock(asr_ctx->mutex);
+        return;
+    }
+    if(job->lang_p < globals.lang_detect_min_p && ++asr_ctx->lang_detect_tries < globals.lang_detect_max_tries) {
+        switch_mutex_unlock(asr_ctx->mutex);
+        return;
+    }
+    switch_copy_string(asr_ctx->lang_detected, lang, sizeof(asr_ctx->lang_detected));
+    __atomic_store_n(&asr_ctx->lang, asr_ctx->lang_detected, __ATOMIC_RELEASE);
+    tries = asr_ctx->lang_detect_tries;
+    switch_mutex_unlock(asr_ctx->mutex);
+
+    metrics_add(&globals.metrics.lang_locked, 1);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Language locked: %s (p=%.2f, tries=%u)\n", lang, job->lang_p, tries);
+
+    if(asr_ctx->uuid && (session = switch_core_session_locate(asr_ctx->uuid))) {
+        switch_channel_set_variable(switch_core_session_get_channel(session), "whisper_asr_language", lang);
+        switch_core_session_rwunlock(session);
+    }
+}
+
+/*
+ * the segments of a job as the text (a line per segment) or the json for asr_get_results,
+ * and the same json as the body of a CUSTOM whisper_asr::result event
+ */
+static char *job_result(wasr_job_t *job, const char *data, uint32_t len) {
+    wasr_ctx_t *asr_ctx = job->asr_ctx;
+    char *records = NULL, *cursor = NULL, *text = NULL, *jstr = NULL;
+    cJSON *json = NULL, *jsegs = NULL;
+    switch_event_t *event = NULL;
+    wasr_segment_t seg = {0};
+    const char *lang = NULL;
+    uint32_t tlen = 0, nsegs = 0;
+    // the worker daemon only knows the audio it was sent
+    int64_t shift_ms = ((globals.fl_remote && job->buffer) ? ((int64_t)(job->audio - job->buffer) * 1000 / WHISPER_SAMPLE_RATE) : 0);
+
+    switch_zmalloc(records, len + 1);
+    switch_zmalloc(text, len + 1);
+    memcpy(records, data, len);
+
+    json = cJSON_CreateObject();
+    jsegs = cJSON_CreateArray();
+    for(cursor = records; segment_parse(&cursor, &seg); nsegs++) {
+        cJSON *jseg = cJSON_CreateObject();
+
+        cJSON_AddNumberToObject(jseg, "t0", (seg.t0 + shift_ms));
+        cJSON_AddNumberToObject(jseg, "t1", (seg.t1 + shift_ms));
+        cJSON_AddNumberToObject(jseg, "p", seg.p);
+        cJSON_AddStringToObject(jseg, "text", seg.text);
+        cJSON_AddItemToArray(jsegs, jseg);
+
+        tlen += snprintf(text + tlen, (len + 1 - tlen), "%s\n", seg.text);
+        lang = (!zstr(seg.lang) ? seg.lang : lang);
+    }
+    // interim results on a second of audio are no ground to lock on
+    if(lang && job->fl_final) {
+        job_lang_lock(job, lang);
+    }
+    lang = (lang ? lang : (asr_ctx->lang ? asr_ctx->lang : DEF_LANG));
+
+    cJSON_AddBoolToObject(json, "final", job->fl_final);
+    // the text result keeps a newline after each segment, json only between them
+    if(tlen) { text[tlen - 1] = '\0'; }
+    cJSON_AddStringToObject(json, "text", text);
+    if(tlen) { text[tlen - 1] = '\n'; }
+    cJSON_AddStringToObject(json, "language", lang);
+    cJSON_AddStringToObject(json, "model", job->model->name);
+    if(asr_ctx->uuid) { cJSON_AddStringToObject(json, "uuid", asr_ctx->uuid); }
+    cJSON_AddNumberToObject(json, "audio_ms", ((uint64_t)job->samples * 1000 / WHISPER_SAMPLE_RATE));
+    cJSON_AddNumberToObject(json, "queue_ms", (job->queue_us / 1000));
+    cJSON_AddNumberToObject(json, "inference_ms", (job->inference_us / 1000));
+    cJSON_AddItemToObject(json, "segments", jsegs);
+    jstr = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+
+    if(asr_ctx->fl_result_events && jstr && switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, WASR_EVENT_RESULT) == SWITCH_STATUS_SUCCESS) {
+        if(asr_ctx->uuid) { switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Unique-ID", asr_ctx->uuid); }
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "ASR-Result-Type", (job->fl_final ? "final" : "partial"));
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "ASR-Language", lang);
+        switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "ASR-Model", job->model->name);
+        switch_event_add_header(event, SWITCH_STACK_BOTTOM, "ASR-Segments", "%u", nsegs);
+        switch_event_add_header(event, SWITCH_STACK_BOTTOM, "ASR-Queue-Wait-Ms", "%"SWITCH_UINT64_T_FMT, (job->queue_us / 1000));
+        switch_event_add_header(event, SWITCH_STACK_BOTTOM, "ASR-Inference-Ms", "%"SWITCH_UINT64_T_FMT, (job->inference_us / 1000));
+        switch_event_add_body(event, "%s", jstr);
+        switch_event_fire(&event);
+    }
+
+    switch_safe_free(records);
+    if(asr_ctx->fl_result_json && jstr) {
+        switch_safe_free(text);
+        return jstr;
+    }
+    switch_safe_free(jstr);
+    return text;
+}
+
+static void job_complete(wasr_job_t *job) {
+    wasr_ctx_t *asr_ctx = job->asr_ctx;
+    const void *ptr = NULL;
+    char *result = NULL;
+    uint32_t tlen = 0;
+
+    if(job_cancelled(job)) {
+        return;
+    }
+
+    if((tlen = switch_buffer_peek_zerocopy(job->text_buffer, &ptr)) > 0) {
+        // don't let interim hypotheses pile up if nobody reads them, the events go out anyway
+        uint8_t fl_queue = (job->fl_final || asr_ctx->transcript_results == 0);
+
+        if((fl_queue || asr_ctx->fl_result_events) && (result = job_result(job, ptr, tlen))) {
+            if(fl_queue && asr_ctx_push_result(asr_ctx, result, strlen(result), (job->fl_final ? 0 : XDATA_FLAG_PARTIAL)) == SWITCH_STATUS_SUCCESS) {
+                metrics_add((job->fl_final ? &globals.metrics.results : &globals.metrics.partials), 1);
             }
+            switch_safe_free(result);
+        }
+    }
 
-            switch_mutex_unlock(asr_ctx->mutex);
-            goto timer_next;
-        }
-
-        fl_transcribe = SWITCH_FALSE;
-        while(switch_queue_trypop(asr_ctx->q_audio, &pop) == SWITCH_STATUS_SUCCESS) {
-            xdata_buffer_t *audio_buffer = (xdata_buffer_t *)pop;
-            if(globals.fl_shutdown || asr_ctx->fl_destroyed ) { break; }
-            if(audio_buffer && audio_buffer->len) {
-                memcpy((chunk_bufferfer + chunk_buffer_offset), audio_buffer->data, audio_buffer->len);
-                chunk_buffer_offset += audio_buffer->len;
-                if(chunk_buffer_offset >= chunk_buffer_size) {
-                    chunk_buffer_offset = chunk_buffer_size;
-                    fl_transcribe = SWITCH_TRUE;
-                    break;
-                }
+    if(job->flush_ts) {
+        metrics_hist_add(&globals.metrics.stages[METRICS_STAGE_TOTAL], (switch_micro_time_now() - job->flush_ts));
+    }
+}
+
+/* only short final chunks with the same decoding language and strategy can share a packed run */
+static uint8_t job_batch_eligible(wasr_job_t *lead, wasr_job_t *job, uint32_t packed_smps) {
+    const char *lang1 = (lead->asr_ctx->lang ? lead->asr_ctx->lang : DEF_LANG);
+    const char *lang2 = (job->asr_ctx->lang ? job->asr_ctx->lang : DEF_LANG);
+
+    if(!lead->fl_final || !job->fl_final || !job->samples) {
+        return SWITCH_FALSE;
+    }
+    if(job->samples > globals.batch_max_job_smps) {
+        return SWITCH_FALSE;
+    }
+    if(packed_smps + globals.batch_gap_smps + job->samples > BATCH_MAX_SAMPLES) {
+        return SWITCH_FALSE;
+    }
+    if(strcasecmp(lang1, lang2) || lead->asr_ctx->whisper_translate != job->asr_ctx->whisper_translate) {
+        return SWITCH_FALSE;
+    }
+    // still detecting, each chunk needs its own pass
+    if(!strcasecmp(lang1, LANG_AUTO)) {
+        return SWITCH_FALSE;
+    }
+    if(lead->model != job->model || !decode_params_equal(lead->asr_ctx, job->asr_ctx)) {
+        return SWITCH_FALSE;
+    }
+    return SWITCH_TRUE;
+}
+
+/*
+ * jobs[0] is already prepared, waits up to batch-wait-ms for other sessions to finish their utterances.
+ * a popped job that can't join the batch is left prepared in jobs[count] and reported through fl_deferred.
+ */
+static uint32_t worker_collect(wasr_worker_t *worker, wasr_job_t *jobs, uint8_t *fl_deferred) {
+    switch_time_t deadline = switch_micro_time_now() + (globals.batch_wait_ms * 1000);
+    uint32_t count = 1, packed_smps = jobs[0].samples;
+    void *pop = NULL;
+
+    *fl_deferred = SWITCH_FALSE;
+
+    if(!job_batch_eligible(&jobs[0], &jobs[0], 0)) {
+        return count;
+    }
+
+    while(count < globals.batch_max_size && !globals.fl_shutdown) {
+        switch_time_t now = switch_micro_time_now();
+        wasr_ctx_t *asr_ctx = NULL;
+
+        if(now >= deadline || jobs_queue_pop_timeout(globals.q_jobs, &pop, (deadline - now)) != SWITCH_STATUS_SUCCESS) {
+            break;
+        }
+        if((asr_ctx = (wasr_ctx_t *)pop) == NULL) {
+            continue;
+        }
+
+        switch_mutex_lock(asr_ctx->mutex);
+        asr_ctx->wakeups++;
+        switch_mutex_unlock(asr_ctx->mutex);
+
+        if(!job_prepare(worker, asr_ctx, &jobs[count])) {
+            asr_ctx_release(asr_ctx);
+            continue;
+        }
+        if(!job_batch_eligible(&jobs[0], &jobs[count], packed_smps)) {
+            *fl_deferred = SWITCH_TRUE;
+            break;
+        }
+
+        packed_smps += globals.batch_gap_smps + jobs[count].samples;
+        count++;
+    }
+
+    return count;
+}
+
+/* gives the audio back to the arena and the session back to the queue */
+static void job_release(wasr_job_t *job) {
+    if(job_cancelled(job)) {
+        metrics_add(&globals.metrics.jobs_cancelled, 1);
+    }
+    buf_arena_free(globals.arena, job->buffer);
+    job->buffer = NULL;
+    job->audio = NULL;
+    asr_ctx_requeue(job->asr_ctx);
+}
+
+static void worker_run(wasr_worker_t *worker, wasr_job_t *jobs, uint32_t count) {
+    wasr_model_t *model = jobs[0].model;
+    switch_time_t started = 0;
+    uint32_t packed_smps = 0, samples = 0;
+    uint32_t n_threads = 0;
+
+    for(uint32_t i = 0; i < count; i++) {
+        jobs[i].text_buffer = worker->text_buffers[i];
+        switch_buffer_zero(jobs[i].text_buffer);
+        job_bind_model(worker, &jobs[i]);
+        samples += jobs[i].samples;
+    }
+
+    if(globals.fl_remote) {
+        // whisper_asr_worker does its own batching and threading
+        for(uint32_t i = 0; i < count; i++) {
+            if(jobs[i].samples && !job_cancelled(&jobs[i]) && remote_transcribe(globals.remote, &jobs[i], &globals) == SWITCH_STATUS_SUCCESS) {
+                job_complete(&jobs[i]);
+            }
+        }
+    } else if(count == 1) {
+        if(jobs[0].samples && !job_cancelled(&jobs[0])) {
+            n_threads = model_threads_acquire(model);
+            started = switch_micro_time_now();
+            if(transcribe(&jobs[0], n_threads, &globals) == SWITCH_STATUS_SUCCESS) {
+                model_account(model, samples, started);
+                job_complete(&jobs[0]);
+            }
+            cpu_governor_release(&globals, n_threads);
+        }
+    } else {
+        packed_smps = jobs_pack(jobs, count, worker->pack_buffer, globals.batch_gap_smps);
+
+        n_threads = model_threads_acquire(model);
+        started = switch_micro_time_now();
+        if(transcribe_batch(jobs, count, worker->pack_buffer, packed_smps, n_threads, &globals) == SWITCH_STATUS_SUCCESS) {
+            model_account(model, samples, started);
+            for(uint32_t i = 0; i < count; i++) {
+                job_complete(&jobs[i]);
             }
-            xdata_buffer_free(&audio_buffer);
         }
+        cpu_governor_release(&globals, n_threads);
+    }
 
-        if(!fl_transcribe) {
-            fl_transcribe = (chunk_buffer_offset > 0 && asr_ctx->vad_state == SWITCH_VAD_STATE_STOP_TALKING);
+    if(globals.batch_max_size > 1 && jobs[0].fl_final) {
+        metrics_add(&globals.metrics.batch_runs, 1);
+        metrics_add(&globals.metrics.batch_jobs, count);
+    }
+}
+
+static void worker_process(wasr_worker_t *worker, wasr_ctx_t *asr_ctx) {
+    wasr_job_t *jobs = worker->jobs;
+    switch_time_t started = switch_micro_time_now();
+    uint8_t fl_deferred = SWITCH_FALSE;
+    uint32_t count = 0;
+
+    // one chunk per pop, the next one of the same session goes through the queue again
+    if(!job_prepare(worker, asr_ctx, &jobs[0])) {
+        asr_ctx_release(asr_ctx);
+        return;
+    }
+
+    count = (globals.batch_max_size > 1 ? worker_collect(worker, jobs, &fl_deferred) : 1);
+
+    worker_run(worker, jobs, count);
+    for(uint32_t i = 0; i < count; i++) {
+        job_release(&jobs[i]);
+    }
+
+    if(fl_deferred) {
+        worker_run(worker, &jobs[count], 1);
+        job_release(&jobs[count]);
+    }
+
+    metrics_add(&globals.metrics.busy_us, (switch_micro_time_now() - started));
+}
+
+static void *SWITCH_THREAD_FUNC whisper_worker_thread(switch_thread_t *thread, void *obj) {
+    wasr_worker_t *worker = (wasr_worker_t *) obj;
+    wasr_model_set_t *mset = NULL;
+    uint32_t slots = globals.batch_max_size + 1;
+    void *pop = NULL;
+
+    if(worker->fl_affinity) {
+        if(thread_set_affinity(worker->cpu_first, worker->n_threads) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unable to set affinity for worker #%u\n", worker->id);
         }
+    }
 
-        if(fl_transcribe) {
-            spx_uint32_t in_smps = (chunk_buffer_offset / sizeof(int16_t));  // to samples
-            spx_uint32_t out_smps = 0;
+    switch_zmalloc(worker->jobs, slots * sizeof(wasr_job_t));
+    switch_zmalloc(worker->text_buffers, slots * sizeof(switch_buffer_t *));
 
-            if(asr_ctx->resampler) {
-                out_smps = (rsmp_buffer_size / sizeof(int16_t));
-                speex_resampler_process_interleaved_int(asr_ctx->resampler, (const spx_int16_t *)chunk_bufferfer, (spx_uint32_t *)&in_smps, (spx_int16_t *)rsmp_buffer, &out_smps);
-                i2f((int16_t *)rsmp_buffer, (float *)float_buffer, out_smps);
-            } else {
-                out_smps = in_smps;
-                i2f((int16_t *)chunk_bufferfer, (float *)float_buffer, out_smps);
+    for(uint32_t i = 0; i < slots; i++) {
+        if(switch_buffer_create_dynamic(&worker->text_buffers[i], 1024, 1024, 16384) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "switch_buffer_create_dynamic()\n");
+            goto out;
+        }
+    }
+    if(globals.batch_max_size > 1) {
+        switch_malloc(worker->pack_buffer, BATCH_MAX_SAMPLES * sizeof(float));
+    }
+    if((mset = model_set_acquire(&globals))) {
+        worker_bind_models(worker, mset);
+        model_set_release(mset);
+    }
+    if(globals.fl_vad_gate) {
+        struct whisper_vad_context_params vparams = whisper_vad_default_context_params();
+
+        vparams.n_threads = globals.vad_gate_threads;
+        vparams.use_gpu = false;
+        if((worker->vctx = whisper_vad_init_from_file_with_params(globals.vad_gate_model, vparams)) == NULL) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unable to load vad model, worker #%u goes without the gate\n", worker->id);
+        }
+    }
+
+    while(SWITCH_TRUE) {
+        if(globals.fl_shutdown) {
+            break;
+        }
+
+        if(jobs_queue_pop_timeout(globals.q_jobs, &pop, WORKER_IDLE_TIMEOUT) == SWITCH_STATUS_SUCCESS) {
+            wasr_ctx_t *asr_ctx = (wasr_ctx_t *)pop;
+            if(asr_ctx) {
+                switch_mutex_lock(asr_ctx->mutex);
+                asr_ctx->wakeups++;
+                switch_mutex_unlock(asr_ctx->mutex);
+
+                worker_process(worker, asr_ctx);
             }
+        } else {
+            switch_mutex_lock(globals.mutex);
+            globals.idle_wakeups++;
+            switch_mutex_unlock(globals.mutex);
 
-            switch_buffer_zero(text_buffer);
-
-            if(transcribe(asr_ctx, (float *)float_buffer, out_smps, text_buffer, &globals) == SWITCH_STATUS_SUCCESS) {
-                const void *ptr = NULL; uint32_t tlen = 0;
-                if((tlen = switch_buffer_peek_zerocopy(text_buffer, &ptr)) > 0) {
-                    if(xdata_buffer_push(asr_ctx->q_text, (switch_byte_t *)ptr, tlen) == SWITCH_STATUS_SUCCESS) {
-                        switch_mutex_lock(asr_ctx->mutex);
-                        asr_ctx->transcript_results++;
-                        switch_mutex_unlock(asr_ctx->mutex);
-                    }
-                }
+            // let the models of an older set go, the next job binds the current one
+            if(worker->mset && worker->mset->gen != __atomic_load_n(&globals.mset_gen, __ATOMIC_ACQUIRE)) {
+                worker_unbind_models(worker);
             }
-            chunk_buffer_offset = 0;
-        }
 
-        timer_next:
-        switch_yield(10000);
+            // replace the idle states taken by a burst of calls
+            sess_pool_fill(globals.sess_pool, &globals);
+        }
     }
 out:
-    if(text_buffer) {
-        switch_buffer_destroy(&text_buffer);
+    for(uint32_t i = 0; i < slots; i++) {
+        if(worker->text_buffers[i]) {
+            switch_buffer_destroy(&worker->text_buffers[i]);
+        }
     }
-    if(pool) {
-        switch_core_destroy_memory_pool(&pool);
+    switch_safe_free(worker->text_buffers);
+    switch_safe_free(worker->jobs);
+    switch_safe_free(worker->pack_buffer);
+    if(worker->vctx) {
+        whisper_vad_free(worker->vctx);
+        worker->vctx = NULL;
     }
-
-    switch_mutex_lock(asr_ctx->mutex);
-    if(asr_ctx->refs > 0) asr_ctx->refs--;
-    switch_mutex_unlock(asr_ctx->mutex);
+    worker_unbind_models(worker);
 
     switch_mutex_lock(globals.mutex);
     if(globals.active_threads > 0) { globals.active_threads--; }
@@ -167,21 +863,28 @@ out:
 // ---------------------------------------------------------------------------------------------------------------------------------------------
 static switch_status_t asr_open(switch_asr_handle_t *ah, const char *codec, int samplerate, const char *dest, switch_asr_flag_t *flags) {
     switch_status_t status = SWITCH_STATUS_SUCCESS;
-    struct whisper_context_params cparams = {0};
-    switch_threadattr_t *attr = NULL;
-    switch_thread_t *thread = NULL;
     wasr_ctx_t *asr_ctx = NULL;
-    int err = 0;
 
     if(strcmp(codec, "L16") !=0) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unsupported encoding: %s\n", codec);
         switch_goto_status(SWITCH_STATUS_FALSE, out);
     }
 
+    // refused up front, so the dialplan can take another node instead of getting a transcript with holes
+    if(load_state() == LOAD_STATE_OVERLOADED) {
+        metrics_add(&globals.metrics.sessions_refused, 1);
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Overloaded, session refused\n");
+        switch_goto_status(SWITCH_STATUS_FALSE, out);
+    }
+
     asr_ctx = switch_core_alloc(ah->memory_pool, sizeof(wasr_ctx_t));
     asr_ctx->samplerate = samplerate;
     asr_ctx->channels = 1;
-    asr_ctx->lang = NULL;
+    switch_mutex_lock(globals.mutex);
+    asr_ctx->lang = switch_core_strdup(ah->memory_pool, globals.lang);
+    asr_ctx->whisper_beam_size = (globals.fl_whisper_beam ? MAX(globals.whisper_beam_size, 1) : 0);
+    asr_ctx->whisper_temperature_inc = globals.whisper_temperature_inc;
+    switch_mutex_unlock(globals.mutex);
 
     ah->private_info = asr_ctx;
 
@@ -190,105 +893,94 @@ static switch_status_t asr_open(switch_asr_handle_t *ah, const char *codec, int
         switch_goto_status(SWITCH_STATUS_GENERR, out);
     }
 
-    switch_queue_create(&asr_ctx->q_audio, QUEUE_SIZE, ah->memory_pool);
-    switch_queue_create(&asr_ctx->q_text, QUEUE_SIZE, ah->memory_pool);
-
-    asr_ctx->fl_vad_enabled = globals.fl_vad_enabled;
-    asr_ctx->frame_len = 0;
-    asr_ctx->vad_buffer = NULL;
-    asr_ctx->vad_buffer_size = 0;
-    asr_ctx->vad_stored_frames = 0;
-    asr_ctx->fl_vad_first_cycle = SWITCH_TRUE;
-
-    if((asr_ctx->vad = switch_vad_init(asr_ctx->samplerate, asr_ctx->channels)) == NULL) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't init VAD\n");
+    if((status = switch_thread_cond_create(&asr_ctx->cond, ah->memory_pool)) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "switch_thread_cond_create()\n");
         switch_goto_status(SWITCH_STATUS_GENERR, out);
     }
 
-    switch_vad_set_mode(asr_ctx->vad, -1);
-    switch_vad_set_param(asr_ctx->vad, "debug", globals.fl_vad_debug);
-    if(globals.vad_silence_ms > 0)  { switch_vad_set_param(asr_ctx->vad, "silence_ms", globals.vad_silence_ms); }
-    if(globals.vad_voice_ms > 0)    { switch_vad_set_param(asr_ctx->vad, "voice_ms", globals.vad_voice_ms); }
-    if(globals.vad_threshold > 0)   { switch_vad_set_param(asr_ctx->vad, "thresh", globals.vad_threshold); }
-
-    if(asr_ctx->samplerate != WHISPER_SAMPLE_RATE) {
-        asr_ctx->resampler = speex_resampler_init(asr_ctx->channels, asr_ctx->samplerate, WHISPER_SAMPLE_RATE, SWITCH_RESAMPLE_QUALITY, &err);
-        if(err != 0) {
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "speex_resampler_init() : %s\n", speex_resampler_strerror(err));
-            switch_goto_status(SWITCH_STATUS_GENERR, out);
-        }
-    }
-
-    cparams = whisper_context_default_params();
-    cparams.use_gpu = globals.whisper_use_gpu;
-    cparams.gpu_device = globals.whisper_gpu_dev;
-    cparams.flash_attn = globals.whisper_flash_attn;
+    switch_queue_create(&asr_ctx->q_text, QUEUE_SIZE, ah->memory_pool);
 
-    if((asr_ctx->wctx = whisper_init_from_file_with_params(globals.model_file, cparams)) == NULL) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "whisper_init_from_file_with_params()\n");
+    asr_ctx->fl_vad_enabled = globals.fl_vad_enabled;
+    asr_ctx->fl_vad_gate = globals.fl_vad_gate;
+    asr_ctx->fl_partial = globals.fl_partial_results;
+    asr_ctx->fl_pause_discard = globals.fl_pause_discard;
+    asr_ctx->fl_result_events = globals.fl_result_events;
+    asr_ctx->fl_result_json = globals.fl_result_json;
+    asr_ctx->partial_interval_smps = (asr_ctx->samplerate * globals.partial_interval_ms) / 1000;
+    asr_ctx->audio_ctx = globals.audio_ctx;
+    asr_ctx->fl_trim_silence = globals.fl_trim_silence;
+    asr_ctx->deadline_ms = globals.sched_deadline_ms;
+    asr_ctx->vad_preroll_ms = globals.vad_preroll_ms;
+    asr_ctx->vad_recovery_ms = (globals.vad_recovery_ms ? globals.vad_recovery_ms : globals.vad_voice_ms);
+    asr_ctx->whisper_max_fallbacks = globals.whisper_max_fallbacks;
+    asr_ctx->whisper_no_context = globals.whisper_no_context;
+    asr_ctx->decode_budget_ms = globals.decode_budget_ms;
+
+    // whisper state, vad and resampler come pre-initialized from the pool
+    if((asr_ctx->res = sess_pool_acquire(globals.sess_pool, asr_ctx->samplerate, &globals)) == NULL) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "sess_pool_acquire()\n");
         switch_goto_status(SWITCH_STATUS_GENERR, out);
     }
+    asr_ctx->vad = asr_ctx->res->vad;
+    asr_ctx->resampler = asr_ctx->res->resampler;
 
-    asr_ctx->chunk_buffer_size = 0;
-
-    switch_mutex_lock(globals.mutex);
-    globals.active_threads++;
-    switch_mutex_unlock(globals.mutex);
+    // the ring keeps up to 2 chunks, so the media thread can go on while a worker transcribes the previous one,
+    // it is taken from the arena with the first voiced frame
+    asr_ctx->chunk_samples = (asr_ctx->samplerate * globals.chunk_time_sec);
+    asr_ctx->ring_samples = audio_ring_size(asr_ctx->chunk_samples * 2);
 
-    switch_threadattr_create(&attr, ah->memory_pool);
-    switch_threadattr_detach_set(attr, 1);
-    switch_threadattr_stacksize_set(attr, SWITCH_THREAD_STACKSIZE);
-    switch_thread_create(&thread, attr, whisper_transcribe_thread, asr_ctx, ah->memory_pool);
+    __atomic_fetch_add(&globals.metrics.sessions_active, 1, __ATOMIC_RELAXED);
+    metrics_add(&globals.metrics.sessions_total, 1);
 
 out:
+    if(status != SWITCH_STATUS_SUCCESS && asr_ctx && asr_ctx->res) {
+        sess_pool_release(globals.sess_pool, asr_ctx->res);
+        asr_ctx->res = NULL;
+    }
     return status;
 }
 
 static switch_status_t asr_close(switch_asr_handle_t *ah, switch_asr_flag_t *flags) {
     wasr_ctx_t *asr_ctx = (wasr_ctx_t *) ah->private_info;
-    uint8_t fl_wloop = SWITCH_TRUE;
+    switch_time_t started = switch_micro_time_now();
 
     assert(asr_ctx != NULL);
 
+    // a queued job is dropped here, a running one gives up at the next abort check, so this is a matter of ms
+    switch_mutex_lock(asr_ctx->mutex);
     asr_ctx->fl_abort = SWITCH_TRUE;
+    asr_ctx_cancel(asr_ctx);
     asr_ctx->fl_destroyed = SWITCH_TRUE;
+    switch_mutex_unlock(asr_ctx->mutex);
+
+    asr_ctx_cancel_remote(asr_ctx);
 
     switch_mutex_lock(asr_ctx->mutex);
-    fl_wloop = (asr_ctx->refs != 0);
+    while(asr_ctx->refs != 0) {
+        switch_thread_cond_wait(asr_ctx->cond, asr_ctx->mutex);
+    }
     switch_mutex_unlock(asr_ctx->mutex);
 
-    if(fl_wloop) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Waiting for unlock (refs=%u)!\n", asr_ctx->refs);
-        while(fl_wloop) {
-            switch_mutex_lock(asr_ctx->mutex);
-            fl_wloop = (asr_ctx->refs != 0);
-            switch_mutex_unlock(asr_ctx->mutex);
-            switch_yield(100000);
-        }
+    if(asr_ctx->audio_ring.overflows) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Audio ring overflows: %u samples\n", asr_ctx->audio_ring.overflows);
     }
-
-    if(asr_ctx->q_audio) {
-        xdata_buffer_queue_clean(asr_ctx->q_audio);
-        switch_queue_term(asr_ctx->q_audio);
+    if(asr_ctx->audio_ring.data) {
+        buf_arena_free(globals.arena, asr_ctx->audio_ring.data);
+        asr_ctx->audio_ring.data = NULL;
     }
+    asr_ctx_backlog_update(asr_ctx);
+    __atomic_fetch_sub(&globals.metrics.sessions_active, 1, __ATOMIC_RELAXED);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Session closed (wakeups=%u, close=%"SWITCH_INT64_T_FMT" us)\n",
+        asr_ctx->wakeups, (int64_t)(switch_micro_time_now() - started));
     if(asr_ctx->q_text) {
         xdata_buffer_queue_clean(asr_ctx->q_text);
         switch_queue_term(asr_ctx->q_text);
     }
-    if(asr_ctx->vad) {
-        switch_vad_destroy(&asr_ctx->vad);
-    }
-
-    if(asr_ctx->wctx) {
-        whisper_free(asr_ctx->wctx);
-    }
-
-    if(asr_ctx->resampler) {
-        speex_resampler_destroy(asr_ctx->resampler);
-    }
-
-    if(asr_ctx->vad_buffer) {
-        switch_buffer_destroy(&asr_ctx->vad_buffer);
+    if(asr_ctx->res) {
+        sess_pool_release(globals.sess_pool, asr_ctx->res);
+        asr_ctx->res = NULL;
+        asr_ctx->vad = NULL;
+        asr_ctx->resampler = NULL;
     }
 
     switch_set_flag(ah, SWITCH_ASR_FLAG_CLOSED);
@@ -300,6 +992,8 @@ static switch_status_t asr_feed(switch_asr_handle_t *ah, void *data, unsigned in
     wasr_ctx_t *asr_ctx = (wasr_ctx_t *) ah->private_info;
     switch_vad_state_t vad_state = 0;
     uint8_t fl_has_audio = SWITCH_FALSE;
+    uint8_t fl_flush = SWITCH_FALSE;
+    uint8_t fl_partial = SWITCH_FALSE;
 
     assert(asr_ctx != NULL);
 
@@ -313,40 +1007,33 @@ static switch_status_t asr_feed(switch_asr_handle_t *ah, void *data, unsigned in
         return SWITCH_STATUS_SUCCESS;
     }
 
-    if(data_len > 0 && asr_ctx->frame_len == 0) {
-        switch_mutex_lock(asr_ctx->mutex);
-        asr_ctx->frame_len = data_len;
-        asr_ctx->vad_buffer_size = asr_ctx->frame_len * VAD_STORE_FRAMES;
-        asr_ctx->chunk_buffer_size = asr_ctx->samplerate * globals.chunk_time_sec;
-        switch_mutex_unlock(asr_ctx->mutex);
+    // the history is sized with the first frame, a per-call vad-preroll-ms/vad-recovery-ms is taken until then
+    if(asr_ctx->fl_vad_enabled && !asr_ctx->vad_history.data && (asr_ctx->vad_preroll_ms + asr_ctx->vad_recovery_ms) > 0) {
+        uint32_t smps = (asr_ctx->samplerate * (asr_ctx->vad_preroll_ms + asr_ctx->vad_recovery_ms) / 1000) + (data_len / sizeof(int16_t));
 
-        if(switch_buffer_create(ah->memory_pool, &asr_ctx->vad_buffer, asr_ctx->vad_buffer_size) != SWITCH_STATUS_SUCCESS) {
-            asr_ctx->vad_buffer_size = 0;
-            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "switch_buffer_create()\n");
+        if(audio_ring_init(&asr_ctx->vad_history, switch_core_alloc(ah->memory_pool, audio_ring_size(smps) * sizeof(int16_t)), smps) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "audio_ring_init()\n");
+            asr_ctx->vad_preroll_ms = asr_ctx->vad_recovery_ms = 0;
         }
     }
 
-    if(asr_ctx->fl_vad_enabled && asr_ctx->vad_buffer_size) {
-        if(asr_ctx->vad_state == SWITCH_VAD_STATE_STOP_TALKING || (asr_ctx->vad_state == vad_state && vad_state == SWITCH_VAD_STATE_NONE)) {
-            if(data_len <= asr_ctx->frame_len) {
-                if(asr_ctx->vad_stored_frames >= VAD_STORE_FRAMES) {
-                    switch_buffer_zero(asr_ctx->vad_buffer);
-                    asr_ctx->vad_stored_frames = 0;
-                    asr_ctx->fl_vad_first_cycle = SWITCH_FALSE;
-                }
-                switch_buffer_write(asr_ctx->vad_buffer, data, MIN(asr_ctx->frame_len, data_len));
-                asr_ctx->vad_stored_frames++;
-            }
+    if(asr_ctx->fl_vad_enabled) {
+        if(asr_ctx->vad_history.data && (asr_ctx->vad_state == SWITCH_VAD_STATE_STOP_TALKING || asr_ctx->vad_state == SWITCH_VAD_STATE_NONE)) {
+            audio_ring_write_over(&asr_ctx->vad_history, (int16_t *)data, (data_len / sizeof(int16_t)));
         }
 
         vad_state = switch_vad_process(asr_ctx->vad, (int16_t *)data, (data_len / sizeof(int16_t)) );
         if(vad_state == SWITCH_VAD_STATE_START_TALKING) {
             asr_ctx->vad_state = vad_state;
             fl_has_audio = SWITCH_TRUE;
+            if(asr_ctx->fl_partial) {
+                asr_ctx_push_result(asr_ctx, NULL, 0, XDATA_FLAG_BEGIN_SPEAKING);
+            }
         } else if (vad_state == SWITCH_VAD_STATE_STOP_TALKING) {
             switch_vad_reset(asr_ctx->vad);
             asr_ctx->vad_state = vad_state;
             fl_has_audio = SWITCH_FALSE;
+            fl_flush = SWITCH_TRUE;
         } else if (vad_state == SWITCH_VAD_STATE_TALKING) {
             asr_ctx->vad_state = vad_state;
             fl_has_audio = SWITCH_TRUE;
@@ -355,58 +1042,69 @@ static switch_status_t asr_feed(switch_asr_handle_t *ah, void *data, unsigned in
         fl_has_audio = SWITCH_TRUE;
     }
 
-    if(fl_has_audio) {
-        if(vad_state == SWITCH_VAD_STATE_START_TALKING && asr_ctx->vad_stored_frames > 0) {
-            xdata_buffer_t *tau_buf = NULL;
-            const void *ptr = NULL;
-            switch_size_t vblen = 0;
-            uint32_t rframes = 0, rlen = 0;
-            int ofs = 0;
-
-            if((vblen = switch_buffer_peek_zerocopy(asr_ctx->vad_buffer, &ptr)) && ptr && vblen > 0) {
-                rframes = (asr_ctx->vad_stored_frames >= VAD_RECOVERY_FRAMES ? VAD_RECOVERY_FRAMES : (asr_ctx->fl_vad_first_cycle ? asr_ctx->vad_stored_frames : VAD_RECOVERY_FRAMES));
-                rlen = (rframes * asr_ctx->frame_len);
-                ofs = (vblen - rlen);
-
-                if(ofs < 0) {
-                    uint32_t hdr_sz = -ofs;
-                    uint32_t hdr_ofs = (asr_ctx->vad_buffer_size - hdr_sz);
-
-                    switch_zmalloc(tau_buf, sizeof(xdata_buffer_t));
-
-                    tau_buf->len = (hdr_sz + vblen + data_len);
-                    switch_malloc(tau_buf->data, tau_buf->len);
+    if(fl_has_audio && !asr_ctx->audio_ring.data) {
+        if(audio_ring_init(&asr_ctx->audio_ring, buf_arena_alloc(globals.arena, asr_ctx->ring_samples * sizeof(int16_t)), asr_ctx->ring_samples) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "audio_ring_init()\n");
+            return SWITCH_STATUS_FALSE;
+        }
+    }
 
-                    memcpy(tau_buf->data, (void *)(ptr + hdr_ofs), hdr_sz);
-                    memcpy(tau_buf->data + hdr_sz , (void *)(ptr + 0), vblen);
-                    memcpy(tau_buf->data + rlen, data, data_len);
+    if(fl_has_audio) {
+        uint32_t hist_smps = 0;
 
-                    if(switch_queue_trypush(asr_ctx->q_audio, tau_buf) != SWITCH_STATUS_SUCCESS) {
-                        xdata_buffer_free(&tau_buf);
-                    }
+        // the voiced frames the vad needed to decide and the pre-roll ahead of them, this frame is the newest in the history
+        if(vad_state == SWITCH_VAD_STATE_START_TALKING && asr_ctx->vad_history.data) {
+            uint32_t want = MAX((asr_ctx->samplerate * (asr_ctx->vad_preroll_ms + asr_ctx->vad_recovery_ms) / 1000), (data_len / sizeof(int16_t)));
+            uint32_t used = audio_ring_used(&asr_ctx->vad_history);
+            int16_t *p1 = NULL, *p2 = NULL;
+            uint32_t l1 = 0, l2 = 0;
 
-                    switch_buffer_zero(asr_ctx->vad_buffer);
-                    asr_ctx->vad_stored_frames = 0;
-                } else {
-                    switch_zmalloc(tau_buf, sizeof(xdata_buffer_t));
+            if(used > want) {
+                audio_ring_consume(&asr_ctx->vad_history, (used - want));
+            }
+            if((hist_smps = audio_ring_peek(&asr_ctx->vad_history, want, &p1, &l1, &p2, &l2)) > 0) {
+                audio_ring_write(&asr_ctx->audio_ring, p1, l1);
+                if(l2) { audio_ring_write(&asr_ctx->audio_ring, p2, l2); }
+            }
+            audio_ring_consume(&asr_ctx->vad_history, audio_ring_used(&asr_ctx->vad_history));
+        }
+        if(!hist_smps) {
+            audio_ring_write(&asr_ctx->audio_ring, (int16_t *)data, (data_len / sizeof(int16_t)));
+        }
 
-                    tau_buf->len = (rlen + data_len);
-                    switch_malloc(tau_buf->data, tau_buf->len);
+        asr_ctx_backlog_update(asr_ctx);
 
-                    memcpy(tau_buf->data, (void *)ptr, rlen);
-                    memcpy(tau_buf->data + rlen, data, data_len);
+        // partial_smps belongs to this thread, the worker only asks for a reset
+        if(__atomic_exchange_n(&asr_ctx->fl_partial_reset, SWITCH_FALSE, __ATOMIC_ACQ_REL)) {
+            asr_ctx->partial_smps = 0;
+        }
+        if(asr_ctx->fl_partial && !fl_flush) {
+            asr_ctx->partial_smps += (data_len / sizeof(int16_t));
+            fl_partial = (asr_ctx->partial_smps >= asr_ctx->partial_interval_smps);
+            // interim results are the first thing to go under load
+            if(fl_partial && load_state() >= LOAD_STATE_DEGRADED) {
+                metrics_add(&globals.metrics.partials_skipped, 1);
+                asr_ctx->partial_smps = 0;
+                fl_partial = SWITCH_FALSE;
+            }
+        }
 
-                    if(switch_queue_trypush(asr_ctx->q_audio, tau_buf) != SWITCH_STATUS_SUCCESS) {
-                        xdata_buffer_free(&tau_buf);
-                    }
+        if(asr_ctx->audio_ring.overflows != asr_ctx->overflows_seen) {
+            metrics_add(&globals.metrics.dropped_smps, (asr_ctx->audio_ring.overflows - asr_ctx->overflows_seen));
+            asr_ctx->overflows_seen = asr_ctx->audio_ring.overflows;
+        }
+    }
 
-                    switch_buffer_zero(asr_ctx->vad_buffer);
-                    asr_ctx->vad_stored_frames = 0;
-                }
-            }
-        } else {
-            xdata_buffer_push(asr_ctx->q_audio, data, data_len);
+    if(fl_flush || fl_partial || (fl_has_audio && audio_ring_used(&asr_ctx->audio_ring) >= asr_ctx->chunk_samples)) {
+        switch_mutex_lock(asr_ctx->mutex);
+        if(fl_flush) {
+            asr_ctx->fl_flush = SWITCH_TRUE;
+            asr_ctx->partial_smps = 0;
+            if(!asr_ctx->flush_ts) { asr_ctx->flush_ts = switch_micro_time_now(); }
         }
+        if(fl_partial) { asr_ctx->fl_partial_req = SWITCH_TRUE; asr_ctx->partial_smps = 0; }
+        asr_ctx_submit(asr_ctx);
+        switch_mutex_unlock(asr_ctx->mutex);
     }
 
     return SWITCH_STATUS_SUCCESS;
@@ -422,6 +1120,7 @@ static switch_status_t asr_check_results(switch_asr_handle_t *ah, switch_asr_fla
 
 static switch_status_t asr_get_results(switch_asr_handle_t *ah, char **xmlstr, switch_asr_flag_t *flags) {
     wasr_ctx_t *asr_ctx = (wasr_ctx_t *)ah->private_info;
+    switch_status_t status = SWITCH_STATUS_FALSE;
     char *result = NULL;
     void *pop = NULL;
 
@@ -433,6 +1132,12 @@ static switch_status_t asr_get_results(switch_asr_handle_t *ah, char **xmlstr, s
             switch_zmalloc(result, tbuff->len + 1);
             memcpy(result, tbuff->data, tbuff->len);
         }
+
+        if(tbuff->flags & XDATA_FLAG_BEGIN_SPEAKING) {
+            status = SWITCH_STATUS_BREAK;
+        } else if(result) {
+            status = ((tbuff->flags & XDATA_FLAG_PARTIAL) ? SWITCH_STATUS_MORE_DATA : SWITCH_STATUS_SUCCESS);
+        }
         xdata_buffer_free(&tbuff);
 
         switch_mutex_lock(asr_ctx->mutex);
@@ -441,8 +1146,7 @@ static switch_status_t asr_get_results(switch_asr_handle_t *ah, char **xmlstr, s
     }
 
     *xmlstr = result;
-    return (result ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE);
-    return SWITCH_STATUS_FALSE;
+    return status;
 }
 
 static switch_status_t asr_start_input_timers(switch_asr_handle_t *ah) {
@@ -460,11 +1164,23 @@ static switch_status_t asr_start_input_timers(switch_asr_handle_t *ah) {
 
 static switch_status_t asr_pause(switch_asr_handle_t *ah) {
     wasr_ctx_t *asr_ctx = (wasr_ctx_t *)ah->private_info;
+    uint8_t fl_cancelled = SWITCH_FALSE;
 
     assert(asr_ctx != NULL);
 
+    switch_mutex_lock(asr_ctx->mutex);
     if(!asr_ctx->fl_pause) {
         asr_ctx->fl_pause = SWITCH_TRUE;
+        // barge-in: what was said before the pause is not wanted anymore
+        if(asr_ctx->fl_pause_discard) {
+            asr_ctx_cancel(asr_ctx);
+            fl_cancelled = SWITCH_TRUE;
+        }
+    }
+    switch_mutex_unlock(asr_ctx->mutex);
+
+    if(fl_cancelled) {
+        asr_ctx_cancel_remote(asr_ctx);
     }
 
     return SWITCH_STATUS_SUCCESS;
@@ -491,14 +1207,69 @@ static void asr_text_param(switch_asr_handle_t *ah, char *param, const char *val
 
     if(strcasecmp(param, "vad") == 0) {
         if(val) asr_ctx->fl_vad_enabled = switch_true(val);
+    } else if(!strcasecmp(param, "model")) {
+        if(val) {
+            wasr_model_set_t *mset = model_set_acquire(&globals);
+            if(mset && !model_set_lookup(mset, val)) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown model: %s\n", val);
+            }
+            model_set_release(mset);
+            asr_ctx->model = switch_core_strdup(ah->memory_pool, val);
+        }
+    } else if(!strcasecmp(param, "vad-gate")) {
+        if(val) asr_ctx->fl_vad_gate = switch_true(val);
     } else if(strcasecmp(param, "lang") == 0) {
-        if(val) asr_ctx->lang = switch_core_strdup(ah->memory_pool, val);
+        if(val) {
+            // under asr_ctx->mutex like job_lang_lock(), release for the unlocked readers of asr_ctx->lang
+            __atomic_store_n(&asr_ctx->lang, switch_core_strdup(ah->memory_pool, val), __ATOMIC_RELEASE);
+            asr_ctx->lang_detect_tries = 0;
+        }
     } else if(!strcasecmp(param, "tokens")) {
         if(val) asr_ctx->whisper_max_tokens = atoi (val);
     } else if(!strcasecmp(param, "translate")) {
         if(val) asr_ctx->whisper_translate = switch_true(val);
     } else if(!strcasecmp(param, "single-segment")) {
         if(val) asr_ctx->whisper_single_segment = switch_true(val);
+    } else if(!strcasecmp(param, "strategy")) {
+        if(val && !strcasecmp(val, "beam")) {
+            asr_ctx->whisper_beam_size = (asr_ctx->whisper_beam_size ? asr_ctx->whisper_beam_size : MAX(globals.whisper_beam_size, 1));
+        } else if(val) {
+            asr_ctx->whisper_beam_size = 0;
+        }
+    } else if(!strcasecmp(param, "beam-size")) {
+        if(val) asr_ctx->whisper_beam_size = atoi (val);
+    } else if(!strcasecmp(param, "temperature-inc")) {
+        if(val) asr_ctx->whisper_temperature_inc = atof(val);
+    } else if(!strcasecmp(param, "max-fallbacks")) {
+        if(val) asr_ctx->whisper_max_fallbacks = atoi (val);
+    } else if(!strcasecmp(param, "no-context")) {
+        if(val) asr_ctx->whisper_no_context = switch_true(val);
+    } else if(!strcasecmp(param, "decode-budget-ms")) {
+        if(val) asr_ctx->decode_budget_ms = atoi (val);
+    } else if(!strcasecmp(param, "audio-ctx")) {
+        if(val) asr_ctx->audio_ctx = audio_ctx_parse(val);
+    } else if(!strcasecmp(param, "trim-silence")) {
+        if(val) asr_ctx->fl_trim_silence = switch_true(val);
+    } else if(!strcasecmp(param, "partial")) {
+        if(val) asr_ctx->fl_partial = switch_true(val);
+    } else if(!strcasecmp(param, "channel-uuid")) {
+        if(val) asr_ctx->uuid = switch_core_strdup(ah->memory_pool, val);
+    } else if(!strcasecmp(param, "result-events")) {
+        if(val) asr_ctx->fl_result_events = switch_true(val);
+    } else if(!strcasecmp(param, "result-format")) {
+        if(val) asr_ctx->fl_result_json = (strcasecmp(val, "json") == 0);
+    } else if(!strcasecmp(param, "vad-preroll-ms")) {
+        if(val) asr_ctx->vad_preroll_ms = atoi (val);
+    } else if(!strcasecmp(param, "vad-recovery-ms")) {
+        if(val) asr_ctx->vad_recovery_ms = atoi (val);
+    } else if(!strcasecmp(param, "pause-discard")) {
+        if(val) asr_ctx->fl_pause_discard = switch_true(val);
+    } else if(!strcasecmp(param, "partial-interval")) {
+        if(val && atoi(val) > 0) asr_ctx->partial_interval_smps = (asr_ctx->samplerate * atoi(val)) / 1000;
+    } else if(!strcasecmp(param, "priority")) {
+        if(val) asr_ctx->priority = atoi (val);
+    } else if(!strcasecmp(param, "deadline-ms")) {
+        if(val) asr_ctx->deadline_ms = atoi (val);
     }
 
     switch_mutex_unlock(asr_ctx->mutex);
@@ -519,15 +1290,229 @@ static switch_status_t asr_unload_grammar(switch_asr_handle_t *ah, const char *n
 }
 
 // ---------------------------------------------------------------------------------------------------------------------------------------------
-// main
+// api
 // ---------------------------------------------------------------------------------------------------------------------------------------------
-SWITCH_MODULE_LOAD_FUNCTION(mod_whisper_asr_load) {
-    switch_status_t status = SWITCH_STATUS_SUCCESS;
-    switch_xml_t cfg, xml, settings, param;
-    switch_asr_interface_t *asr_interface;
+#define WHISPER_ASR_API_SYNTAX "status [json] | reload"
+
+/* audio buffers in flight, per active session */
+static void status_print_memory(switch_stream_handle_t *stream) {
+    buf_arena_t *arena = globals.arena;
+    uint32_t sessions = __atomic_load_n(&globals.metrics.sessions_active, __ATOMIC_RELAXED);
+    uint64_t rss = 0, file = 0;
+
+    switch_mutex_lock(arena->mutex);
+    stream->write_function(stream, "memory: in_use=%.1f MB, peak=%.1f MB, idle=%.1f MB, per_session=%.1f KB, reuse=%.1f%%\n",
+        (arena->used_bytes / 1048576.0), (arena->used_peak / 1048576.0), (arena->idle_bytes / 1048576.0),
+        (sessions ? (arena->used_bytes / 1024.0 / sessions) : 0.0), (arena->allocs ? (100.0 * arena->reuses / arena->allocs) : 0.0));
+    switch_mutex_unlock(arena->mutex);
+
+    // file-backed is libraries and mapped files, the model weights are in anon (whisper keeps its own copy)
+    if(proc_mem_stat(&rss, &file) == SWITCH_STATUS_SUCCESS) {
+        stream->write_function(stream, "process: rss=%.1f MB, file-backed=%.1f MB, anon=%.1f MB\n",
+            (rss / 1048576.0), (file / 1048576.0), ((rss - MIN(file, rss)) / 1048576.0));
+    }
+}
 
-    memset(&globals, 0, sizeof(globals));
-    switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, pool);
+static void status_print_text(switch_stream_handle_t *stream, wasr_model_set_t *mset) {
+    metrics_t *metrics = &globals.metrics;
+    double uptime_us = (double)MAX(switch_micro_time_now() - metrics->started, 1);
+    uint64_t audio_us = __atomic_load_n(&metrics->audio_us, __ATOMIC_RELAXED);
+    uint64_t inference_us = __atomic_load_n(&metrics->inference_us, __ATOMIC_RELAXED);
+    uint64_t busy_us = __atomic_load_n(&metrics->busy_us, __ATOMIC_RELAXED);
+
+    stream->write_function(stream, "uptime: %.0f sec\n", (uptime_us / 1000000.0));
+    stream->write_function(stream, "sessions: active=%u, total=%"SWITCH_UINT64_T_FMT"\n", __atomic_load_n(&metrics->sessions_active, __ATOMIC_RELAXED), metrics->sessions_total);
+    stream->write_function(stream, "workers: %u, utilization=%.1f%%, idle_wakeups=%"SWITCH_UINT64_T_FMT"\n",
+        globals.workers, (100.0 * busy_us / (uptime_us * globals.workers)), globals.idle_wakeups);
+    if(globals.fl_remote) {
+        stream->write_function(stream, "remote: %s, connected=%u/%u, in_flight=%u, requests=%"SWITCH_UINT64_T_FMT", errors=%"SWITCH_UINT64_T_FMT", connects=%"SWITCH_UINT64_T_FMT"\n",
+            globals.remote->address, remote_client_connected(globals.remote), globals.remote->conns_count, remote_client_in_flight(globals.remote),
+            globals.remote->requests, globals.remote->errors, globals.remote->connects);
+    } else if(globals.cpu_budget) {
+        stream->write_function(stream, "cpu: budget=%u, in_use=%u, running=%u, threads=%u..%u\n",
+            globals.cpu_budget, globals.cpu_in_use, globals.cpu_running, globals.cpu_min_threads, globals.cpu_max_threads);
+    } else {
+        stream->write_function(stream, "cpu: fixed %u threads per inference\n", globals.whisper_n_threads);
+    }
+    metrics_print_threads(metrics, stream);
+    status_print_memory(stream);
+    stream->write_function(stream, "pool: idle=%u, allocated=%u, min=%u, max=%u, hits=%"SWITCH_UINT64_T_FMT", misses=%"SWITCH_UINT64_T_FMT"\n",
+        globals.sess_pool->size, globals.sess_pool->created, globals.sess_pool->min, globals.sess_pool->max, globals.sess_pool->hits, globals.sess_pool->misses);
+    stream->write_function(stream, "jobs: done=%"SWITCH_UINT64_T_FMT", queued=%u, rejected=%"SWITCH_UINT64_T_FMT", cancelled=%"SWITCH_UINT64_T_FMT", aborted=%"SWITCH_UINT64_T_FMT"\n",
+        metrics->jobs, jobs_queue_size(globals.q_jobs), metrics->jobs_rejected, metrics->jobs_cancelled, metrics->inferences_aborted);
+    stream->write_function(stream, "results: final=%"SWITCH_UINT64_T_FMT", partial=%"SWITCH_UINT64_T_FMT", lang_detections=%"SWITCH_UINT64_T_FMT", lang_locked=%"SWITCH_UINT64_T_FMT"\n",
+        metrics->results, metrics->partials, metrics->lang_detections, metrics->lang_locked);
+    stream->write_function(stream, "decoding: %s, temperature_inc=%.2f, max_fallbacks=%u, budget=%u ms, fallbacks=%"SWITCH_UINT64_T_FMT", budget_hits=%"SWITCH_UINT64_T_FMT"\n",
+        (globals.fl_whisper_beam ? "beam" : "greedy"), globals.whisper_temperature_inc, globals.whisper_max_fallbacks, globals.decode_budget_ms, metrics->decode_fallbacks, metrics->decode_budget_hits);
+    stream->write_function(stream, "audio: %.1f sec, rtf=%.3f, dropped=%"SWITCH_UINT64_T_FMT" samples, discarded=%"SWITCH_UINT64_T_FMT" samples\n",
+        (audio_us / 1000000.0), (audio_us ? ((double)inference_us / audio_us) : 0.0), metrics->dropped_smps, metrics->discarded_smps);
+    stream->write_function(stream, "load: %s, backlog=%.1f sec, queue_wait=%"SWITCH_UINT64_T_FMT" ms, refused=%"SWITCH_UINT64_T_FMT", degraded=%"SWITCH_UINT64_T_FMT" jobs, partials_skipped=%"SWITCH_UINT64_T_FMT", results_dropped=%"SWITCH_UINT64_T_FMT"\n",
+        load_state_name(load_state()), (MAX(globals.backlog_us, 0) / 1000000.0), (globals.queue_wait_us / 1000), metrics->sessions_refused, metrics->jobs_degraded, metrics->partials_skipped, metrics->results_dropped);
+    if(!globals.fl_remote) {
+        stream->write_function(stream, "models: set #%u, reloads=%u, loaded in %"SWITCH_UINT64_T_FMT" ms (%s)\n",
+            mset->gen, globals.reloads, (mset->load_us / 1000), (globals.fl_model_mmap ? "mmap" : "file"));
+    }
+    for(uint32_t i = 0; mset->count > 1 && i < mset->count; i++) {
+        wasr_model_t *model = &mset->models[i];
+        uint64_t m_audio_us = __atomic_load_n(&model->audio_us, __ATOMIC_RELAXED);
+        stream->write_function(stream, "model %s: jobs=%"SWITCH_UINT64_T_FMT", forced=%"SWITCH_UINT64_T_FMT", audio=%.1f sec, rtf=%.3f, size=%.1f MB, load=%"SWITCH_UINT64_T_FMT" ms\n",
+            model->name, model->routed, model->forced, (m_audio_us / 1000000.0), (m_audio_us ? ((double)model->inference_us / m_audio_us) : 0.0),
+            (model->file_size / 1048576.0), (model->load_us / 1000));
+    }
+    if(globals.fl_vad_gate) {
+        stream->write_function(stream, "vad gate: gated=%"SWITCH_UINT64_T_FMT" jobs, skipped=%.1f sec, trimmed=%.1f sec\n",
+            metrics->vad_gated, (metrics->vad_skipped_us / 1000000.0), (metrics->vad_trimmed_us / 1000000.0));
+    }
+    if(globals.batch_max_size > 1) {
+        stream->write_function(stream, "batching: runs=%"SWITCH_UINT64_T_FMT", jobs=%"SWITCH_UINT64_T_FMT", fill=%.2f\n",
+            metrics->batch_runs, metrics->batch_jobs, metrics_batch_fill(metrics, globals.batch_max_size));
+    }
+    metrics_print_stages(metrics, stream);
+}
+
+static void status_print_json(switch_stream_handle_t *stream, wasr_model_set_t *mset) {
+    metrics_t *metrics = &globals.metrics;
+    double uptime_us = (double)MAX(switch_micro_time_now() - metrics->started, 1);
+    uint64_t audio_us = __atomic_load_n(&metrics->audio_us, __ATOMIC_RELAXED);
+    uint64_t inference_us = __atomic_load_n(&metrics->inference_us, __ATOMIC_RELAXED);
+    uint64_t busy_us = __atomic_load_n(&metrics->busy_us, __ATOMIC_RELAXED);
+    cJSON *json = cJSON_CreateObject();
+    uint64_t rss = 0, file = 0;
+    char *jstr = NULL;
+
+    cJSON_AddNumberToObject(json, "uptime_sec", (uptime_us / 1000000.0));
+    cJSON_AddNumberToObject(json, "sessions_active", __atomic_load_n(&metrics->sessions_active, __ATOMIC_RELAXED));
+    cJSON_AddNumberToObject(json, "sessions_total", metrics->sessions_total);
+    cJSON_AddNumberToObject(json, "workers", globals.workers);
+    cJSON_AddNumberToObject(json, "worker_threads", globals.whisper_n_threads);
+    if(globals.fl_remote) {
+        cJSON *jremote = cJSON_CreateObject();
+        cJSON_AddStringToObject(jremote, "address", globals.remote->address);
+        cJSON_AddNumberToObject(jremote, "connections", globals.remote->conns_count);
+        cJSON_AddNumberToObject(jremote, "connected", remote_client_connected(globals.remote));
+        cJSON_AddNumberToObject(jremote, "in_flight", remote_client_in_flight(globals.remote));
+        cJSON_AddNumberToObject(jremote, "requests", globals.remote->requests);
+        cJSON_AddNumberToObject(jremote, "errors", globals.remote->errors);
+        cJSON_AddNumberToObject(jremote, "connects", globals.remote->connects);
+        cJSON_AddItemToObject(json, "remote", jremote);
+    }
+    cJSON_AddNumberToObject(json, "cpu_budget", globals.cpu_budget);
+    cJSON_AddNumberToObject(json, "cpu_in_use", globals.cpu_in_use);
+    cJSON_AddNumberToObject(json, "cpu_running", globals.cpu_running);
+    cJSON_AddItemToObject(json, "threads", metrics_threads_json(metrics));
+    switch_mutex_lock(globals.arena->mutex);
+    cJSON_AddNumberToObject(json, "memory_in_use", globals.arena->used_bytes);
+    cJSON_AddNumberToObject(json, "memory_peak", globals.arena->used_peak);
+    cJSON_AddNumberToObject(json, "memory_idle", globals.arena->idle_bytes);
+    cJSON_AddNumberToObject(json, "memory_per_session", (metrics->sessions_active ? ((double)globals.arena->used_bytes / metrics->sessions_active) : 0.0));
+    switch_mutex_unlock(globals.arena->mutex);
+    cJSON_AddNumberToObject(json, "pool_idle", globals.sess_pool->size);
+    cJSON_AddNumberToObject(json, "pool_allocated", globals.sess_pool->created);
+    cJSON_AddNumberToObject(json, "pool_hits", globals.sess_pool->hits);
+    cJSON_AddNumberToObject(json, "pool_misses", globals.sess_pool->misses);
+    cJSON_AddNumberToObject(json, "worker_utilization", (busy_us / (uptime_us * globals.workers)));
+    cJSON_AddNumberToObject(json, "idle_wakeups", globals.idle_wakeups);
+    cJSON_AddNumberToObject(json, "jobs", metrics->jobs);
+    cJSON_AddNumberToObject(json, "jobs_queued", jobs_queue_size(globals.q_jobs));
+    cJSON_AddNumberToObject(json, "jobs_rejected", metrics->jobs_rejected);
+    cJSON_AddNumberToObject(json, "jobs_cancelled", metrics->jobs_cancelled);
+    cJSON_AddNumberToObject(json, "inferences_aborted", metrics->inferences_aborted);
+    cJSON_AddNumberToObject(json, "results", metrics->results);
+    cJSON_AddNumberToObject(json, "partials", metrics->partials);
+    cJSON_AddNumberToObject(json, "lang_detections", metrics->lang_detections);
+    cJSON_AddNumberToObject(json, "lang_locked", metrics->lang_locked);
+    cJSON_AddNumberToObject(json, "decode_fallbacks", metrics->decode_fallbacks);
+    cJSON_AddNumberToObject(json, "decode_budget_hits", metrics->decode_budget_hits);
+    cJSON_AddNumberToObject(json, "audio_sec", (audio_us / 1000000.0));
+    cJSON_AddNumberToObject(json, "rtf", (audio_us ? ((double)inference_us / audio_us) : 0.0));
+    cJSON_AddNumberToObject(json, "dropped_samples", metrics->dropped_smps);
+    cJSON_AddNumberToObject(json, "discarded_samples", metrics->discarded_smps);
+    cJSON_AddStringToObject(json, "load_state", load_state_name(load_state()));
+    cJSON_AddNumberToObject(json, "backlog_sec", (MAX(globals.backlog_us, 0) / 1000000.0));
+    cJSON_AddNumberToObject(json, "queue_wait_ms", (globals.queue_wait_us / 1000));
+    cJSON_AddNumberToObject(json, "sessions_refused", metrics->sessions_refused);
+    cJSON_AddNumberToObject(json, "jobs_degraded", metrics->jobs_degraded);
+    cJSON_AddNumberToObject(json, "partials_skipped", metrics->partials_skipped);
+    cJSON_AddNumberToObject(json, "results_dropped", metrics->results_dropped);
+    cJSON_AddNumberToObject(json, "vad_gated", metrics->vad_gated);
+    cJSON_AddNumberToObject(json, "vad_skipped_sec", (metrics->vad_skipped_us / 1000000.0));
+    cJSON_AddNumberToObject(json, "vad_trimmed_sec", (metrics->vad_trimmed_us / 1000000.0));
+    cJSON_AddNumberToObject(json, "batch_runs", metrics->batch_runs);
+    cJSON_AddNumberToObject(json, "batch_jobs", metrics->batch_jobs);
+    cJSON_AddNumberToObject(json, "batch_fill", metrics_batch_fill(metrics, globals.batch_max_size));
+    cJSON_AddNumberToObject(json, "reloads", globals.reloads);
+    cJSON_AddNumberToObject(json, "model_set", mset->gen);
+    cJSON_AddNumberToObject(json, "model_load_ms", (mset->load_us / 1000));
+    if(proc_mem_stat(&rss, &file) == SWITCH_STATUS_SUCCESS) {
+        cJSON_AddNumberToObject(json, "process_rss", rss);
+        cJSON_AddNumberToObject(json, "process_file_backed", file);
+    }
+    if(mset->count > 1) {
+        cJSON *jmodels = cJSON_CreateArray();
+        for(uint32_t i = 0; i < mset->count; i++) {
+            wasr_model_t *model = &mset->models[i];
+            cJSON *jmodel = cJSON_CreateObject();
+            cJSON_AddStringToObject(jmodel, "name", model->name);
+            cJSON_AddNumberToObject(jmodel, "jobs", model->routed);
+            cJSON_AddNumberToObject(jmodel, "forced", model->forced);
+            cJSON_AddNumberToObject(jmodel, "audio_sec", (model->audio_us / 1000000.0));
+            cJSON_AddNumberToObject(jmodel, "rtf", (model->audio_us ? ((double)model->inference_us / model->audio_us) : 0.0));
+            cJSON_AddNumberToObject(jmodel, "file_size", model->file_size);
+            cJSON_AddNumberToObject(jmodel, "load_ms", (model->load_us / 1000));
+            cJSON_AddItemToArray(jmodels, jmodel);
+        }
+        cJSON_AddItemToObject(json, "models", jmodels);
+    }
+    cJSON_AddItemToObject(json, "stages", metrics_stages_json(metrics));
+
+    if((jstr = cJSON_PrintUnformatted(json))) {
+        stream->write_function(stream, "%s\n", jstr);
+        switch_safe_free(jstr);
+    }
+    cJSON_Delete(json);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// config
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+static void config_defaults(globals_t *conf) {
+    conf->audio_ctx_min = DEF_AUDIO_CTX_MIN;
+    conf->audio_ctx_pad = DEF_AUDIO_CTX_PAD;
+    conf->trim_pad_ms = DEF_TRIM_PAD_MS;
+    conf->vad_preroll_ms = DEF_VAD_PREROLL_MS;
+    conf->fl_result_events = SWITCH_TRUE;
+    conf->vad_gate_threshold = DEF_VAD_GATE_THRESHOLD;
+    switch_copy_string(conf->lang, DEF_LANG, sizeof(conf->lang));
+    conf->lang_detect_min_p = DEF_LANG_DETECT_MIN_P;
+    conf->lang_detect_max_tries = DEF_LANG_DETECT_TRIES;
+    conf->whisper_beam_size = DEF_BEAM_SIZE;
+    conf->whisper_temperature_inc = DEF_TEMPERATURE_INC;
+    conf->whisper_max_fallbacks = DEF_MAX_FALLBACKS;
+    conf->whisper_no_context = SWITCH_TRUE;
+    conf->vad_gate_min_speech_ms = DEF_VAD_GATE_MIN_SPEECH;
+    conf->vad_gate_threads = DEF_VAD_GATE_THREADS;
+    conf->fl_sched_sjf = SWITCH_TRUE;
+    conf->sched_cost_weight = DEF_SCHED_COST_WEIGHT;
+    conf->sched_max_age_ms = DEF_SCHED_MAX_AGE_MS;
+    conf->sched_prio_step_ms = DEF_SCHED_PRIO_STEP_MS;
+    conf->batch_max_size = 1;
+    conf->batch_wait_ms = DEF_BATCH_WAIT_MS;
+    conf->pool_min = DEF_POOL_MIN;
+    conf->pool_max = DEF_POOL_MAX;
+    conf->pool_rates = DEF_POOL_RATES;
+    conf->arena_max_idle_mb = DEF_ARENA_MAX_IDLE_MB;
+    conf->fl_pool_warmup = SWITCH_TRUE;
+    conf->fl_model_mmap = SWITCH_TRUE;
+    conf->fl_model_populate = SWITCH_TRUE;
+    conf->batch_max_job_smps = (DEF_BATCH_MAX_JOB_MS * (WHISPER_SAMPLE_RATE / 1000));
+    conf->batch_gap_smps = (DEF_BATCH_GAP_MS * (WHISPER_SAMPLE_RATE / 1000));
+}
+
+/* reads the config into 'conf' and the models into 'mset', the strings of the settings go to 'pool', the ones of the models to the set */
+static switch_status_t config_load(globals_t *conf, wasr_model_set_t *mset, switch_memory_pool_t *pool) {
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+    switch_xml_t cfg, xml, settings, param, models, xmodel;
+    uint32_t ncpu = 0;
 
     if((xml = switch_xml_open_cfg(MOD_CONFIG_NAME, &cfg, NULL)) == NULL) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to open configuration: %s\n", MOD_CONFIG_NAME);
@@ -540,46 +1525,506 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_whisper_asr_load) {
             char *val = (char *) switch_xml_attr_soft(param, "value");
 
             if(!strcasecmp(var, "vad-silence-ms")) {
-                if(val) globals.vad_silence_ms = atoi (val);
+                if(val) conf->vad_silence_ms = atoi (val);
             } else if(!strcasecmp(var, "vad-voice-ms")) {
-                if(val) globals.vad_voice_ms = atoi (val);
+                if(val) conf->vad_voice_ms = atoi (val);
+            } else if(!strcasecmp(var, "vad-preroll-ms")) {
+                if(val) conf->vad_preroll_ms = atoi (val);
+            } else if(!strcasecmp(var, "vad-recovery-ms")) {
+                if(val) conf->vad_recovery_ms = atoi (val);
             } else if(!strcasecmp(var, "vad-threshold")) {
-                if(val) globals.vad_threshold = atoi (val);
+                if(val) conf->vad_threshold = atoi (val);
             } else if(!strcasecmp(var, "vad-enable")) {
-                if(val) globals.fl_vad_enabled = switch_true(val);
+                if(val) conf->fl_vad_enabled = switch_true(val);
+            } else if(!strcasecmp(var, "vad-gate")) {
+                if(val) conf->fl_vad_gate = (!strcasecmp(val, "silero") || switch_true(val));
+            } else if(!strcasecmp(var, "vad-gate-model")) {
+                if(val) conf->vad_gate_model = switch_core_strdup(pool, val);
+            } else if(!strcasecmp(var, "lang")) {
+                if(val) switch_copy_string(conf->lang, val, sizeof(conf->lang));
+            } else if(!strcasecmp(var, "lang-detect-min-p")) {
+                if(val) conf->lang_detect_min_p = atof(val);
+            } else if(!strcasecmp(var, "lang-detect-max-tries")) {
+                if(val) conf->lang_detect_max_tries = atoi (val);
+            } else if(!strcasecmp(var, "vad-gate-threshold")) {
+                if(val) conf->vad_gate_threshold = atof(val);
+            } else if(!strcasecmp(var, "vad-gate-min-speech-ms")) {
+                if(val) conf->vad_gate_min_speech_ms = atoi (val);
+            } else if(!strcasecmp(var, "vad-gate-threads")) {
+                if(val) conf->vad_gate_threads = atoi (val);
             } else if(!strcasecmp(var, "vad-debug")) {
-                if(val) globals.fl_vad_debug = switch_true(val);
+                if(val) conf->fl_vad_debug = switch_true(val);
             } else if(!strcasecmp(var, "model")) {
-                if(val) globals.model_file = switch_core_strdup(pool, val);
+                if(val) conf->model_file = switch_core_strdup(pool, val);
             } else if(!strcasecmp(var, "chunk-time-sec")) {
-                if(val) globals.chunk_time_sec = atoi (val);
+                if(val) conf->chunk_time_sec = atoi (val);
             } else if(!strcasecmp(var, "whisper-n-threads")) {
-                if(val) globals.whisper_n_threads = atoi (val);
+                if(val) conf->whisper_n_threads = atoi (val);
             } else if(!strcasecmp(var, "whisper-max-tokens")) {
-                if(val) globals.whisper_max_tokens = atoi (val);
+                if(val) conf->whisper_max_tokens = atoi (val);
+            } else if(!strcasecmp(var, "whisper-strategy")) {
+                if(val) conf->fl_whisper_beam = (strcasecmp(val, "beam") == 0);
+            } else if(!strcasecmp(var, "whisper-beam-size")) {
+                if(val) conf->whisper_beam_size = atoi (val);
+            } else if(!strcasecmp(var, "whisper-temperature-inc")) {
+                if(val) conf->whisper_temperature_inc = atof(val);
+            } else if(!strcasecmp(var, "whisper-max-fallbacks")) {
+                if(val) conf->whisper_max_fallbacks = atoi (val);
+            } else if(!strcasecmp(var, "whisper-no-context")) {
+                if(val) conf->whisper_no_context = switch_true(val);
+            } else if(!strcasecmp(var, "decode-budget-ms")) {
+                if(val) conf->decode_budget_ms = atoi (val);
             } else if(!strcasecmp(var, "whisper-use-gpu")) {
-                if(val) globals.whisper_use_gpu = switch_true(val);
+                if(val) conf->whisper_use_gpu = switch_true(val);
             } else if(!strcasecmp(var, "whisper-flash-attn")) {
-                if(val) globals.whisper_flash_attn = switch_true(val);
+                if(val) conf->whisper_flash_attn = switch_true(val);
             } else if(!strcasecmp(var, "whisper-gpu-dev")) {
-                if(val) globals.whisper_gpu_dev = atoi (val);
+                if(val) conf->whisper_gpu_dev = atoi (val);
+            } else if(!strcasecmp(var, "audio-ctx")) {
+                if(val) conf->audio_ctx = audio_ctx_parse(val);
+            } else if(!strcasecmp(var, "audio-ctx-min")) {
+                if(val) conf->audio_ctx_min = atoi (val);
+            } else if(!strcasecmp(var, "audio-ctx-pad")) {
+                if(val) conf->audio_ctx_pad = atoi (val);
+            } else if(!strcasecmp(var, "trim-silence")) {
+                if(val) conf->fl_trim_silence = switch_true(val);
+            } else if(!strcasecmp(var, "trim-pad-ms")) {
+                if(val) conf->trim_pad_ms = atoi (val);
+            } else if(!strcasecmp(var, "partial-results")) {
+                if(val) conf->fl_partial_results = switch_true(val);
+            } else if(!strcasecmp(var, "pause-discard")) {
+                if(val) conf->fl_pause_discard = switch_true(val);
+            } else if(!strcasecmp(var, "result-events")) {
+                if(val) conf->fl_result_events = switch_true(val);
+            } else if(!strcasecmp(var, "result-format")) {
+                if(val) conf->fl_result_json = (strcasecmp(val, "json") == 0);
+            } else if(!strcasecmp(var, "partial-interval-ms")) {
+                if(val) conf->partial_interval_ms = atoi (val);
+            } else if(!strcasecmp(var, "workers")) {
+                if(val) conf->workers = atoi (val);
+            } else if(!strcasecmp(var, "worker-cpu-affinity")) {
+                if(val) conf->fl_worker_affinity = switch_true(val);
+            } else if(!strcasecmp(var, "backend")) {
+                if(val) conf->fl_remote = (strcasecmp(val, "remote") == 0);
+            } else if(!strcasecmp(var, "remote-address")) {
+                if(val) conf->remote_address = switch_core_strdup(pool, val);
+            } else if(!strcasecmp(var, "remote-connections")) {
+                if(val) conf->remote_connections = atoi (val);
+            } else if(!strcasecmp(var, "remote-timeout-ms")) {
+                if(val) conf->remote_timeout_ms = atoi (val);
+            } else if(!strcasecmp(var, "arena-max-idle-mb")) {
+                if(val) conf->arena_max_idle_mb = atoi (val);
+            } else if(!strcasecmp(var, "pool-min")) {
+                if(val) conf->pool_min = atoi (val);
+            } else if(!strcasecmp(var, "pool-max")) {
+                if(val) conf->pool_max = atoi (val);
+            } else if(!strcasecmp(var, "pool-rates")) {
+                if(val) conf->pool_rates = switch_core_strdup(pool, val);
+            } else if(!strcasecmp(var, "pool-warmup")) {
+                if(val) conf->fl_pool_warmup = switch_true(val);
+            } else if(!strcasecmp(var, "model-loader")) {
+                if(val) conf->fl_model_mmap = (strcasecmp(val, "file") != 0);
+            } else if(!strcasecmp(var, "model-populate")) {
+                if(val) conf->fl_model_populate = switch_true(val);
+            } else if(!strcasecmp(var, "admit-max-backlog-ms")) {
+                if(val) conf->admit_max_backlog_ms = atoi (val);
+            } else if(!strcasecmp(var, "admit-max-queue")) {
+                if(val) conf->admit_max_queue = atoi (val);
+            } else if(!strcasecmp(var, "admit-max-wait-ms")) {
+                if(val) conf->admit_max_wait_ms = atoi (val);
+            } else if(!strcasecmp(var, "degrade-backlog-ms")) {
+                if(val) conf->degrade_backlog_ms = atoi (val);
+            } else if(!strcasecmp(var, "degrade-model")) {
+                if(val) conf->degrade_model = switch_core_strdup(pool, val);
+            } else if(!strcasecmp(var, "cpu-budget")) {
+                if(val) conf->cpu_budget = (strcasecmp(val, "auto") ? (uint32_t)atoi (val) : UINT32_MAX);
+            } else if(!strcasecmp(var, "cpu-min-threads")) {
+                if(val) conf->cpu_min_threads = atoi (val);
+            } else if(!strcasecmp(var, "cpu-max-threads")) {
+                if(val) conf->cpu_max_threads = atoi (val);
+            } else if(!strcasecmp(var, "sched-policy")) {
+                if(val) conf->fl_sched_sjf = (strcasecmp(val, "fifo") != 0);
+            } else if(!strcasecmp(var, "sched-cost-weight")) {
+                if(val) conf->sched_cost_weight = atoi (val);
+            } else if(!strcasecmp(var, "sched-max-age-ms")) {
+                if(val) conf->sched_max_age_ms = atoi (val);
+            } else if(!strcasecmp(var, "sched-priority-step-ms")) {
+                if(val) conf->sched_prio_step_ms = atoi (val);
+            } else if(!strcasecmp(var, "sched-deadline-ms")) {
+                if(val) conf->sched_deadline_ms = atoi (val);
+            } else if(!strcasecmp(var, "batch-max-size")) {
+                if(val) conf->batch_max_size = atoi (val);
+            } else if(!strcasecmp(var, "batch-wait-ms")) {
+                if(val) conf->batch_wait_ms = atoi (val);
+            } else if(!strcasecmp(var, "batch-max-job-ms")) {
+                if(val) conf->batch_max_job_smps = atoi (val) * (WHISPER_SAMPLE_RATE / 1000);
+            } else if(!strcasecmp(var, "batch-gap-ms")) {
+                if(val) conf->batch_gap_smps = atoi (val) * (WHISPER_SAMPLE_RATE / 1000);
             }
         }
     }
 
-    if(!globals.model_file) {
+    // <model name="tiny" file="ggml-tiny-q5_1.bin" max-duration-ms="3000" langs="en,de" threads="4" flash-attn="true"/>
+    if((models = switch_xml_child(cfg, "models"))) {
+        for(xmodel = switch_xml_child(models, "model"); xmodel; xmodel = xmodel->next) {
+            const char *name = switch_xml_attr(xmodel, "name");
+            const char *file = switch_xml_attr(xmodel, "file");
+            const char *val = NULL;
+            wasr_model_t *model = NULL;
+
+            if(zstr(name) || zstr(file) || !strcasecmp(name, "default")) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid model: name and file are required (and 'default' is the model setting)\n");
+                switch_goto_status(SWITCH_STATUS_GENERR, out);
+            }
+            if(model_set_lookup(mset, name)) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Duplicate model: %s\n", name);
+                switch_goto_status(SWITCH_STATUS_GENERR, out);
+            }
+            if(mset->count >= MODELS_MAX) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Too many models, '%s' ignored\n", name);
+                continue;
+            }
+
+            model = &mset->models[mset->count++];
+            model->name = switch_core_strdup(mset->pool, name);
+            model->file = switch_core_strdup(mset->pool, file);
+            model->fl_flash_attn = conf->whisper_flash_attn;
+            if((val = switch_xml_attr(xmodel, "langs")) && !zstr(val)) {
+                model->langs = switch_core_strdup(mset->pool, val);
+            }
+            if((val = switch_xml_attr(xmodel, "max-duration-ms"))) {
+                model->max_ms = atoi(val);
+            }
+            if((val = switch_xml_attr(xmodel, "threads"))) {
+                model->n_threads = atoi(val);
+            }
+            if((val = switch_xml_attr(xmodel, "flash-attn"))) {
+                model->fl_flash_attn = switch_true(val);
+            }
+        }
+    }
+
+    if(conf->fl_remote) {
+        if(zstr(conf->remote_address)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid parameter: remote-address\n");
+            switch_goto_status(SWITCH_STATUS_GENERR, out);
+        }
+    } else if(!conf->model_file) {
         switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid parameter: model\n");
         switch_goto_status(SWITCH_STATUS_GENERR, out);
+    } else {
+        mset->models[0].file = switch_core_strdup(mset->pool, conf->model_file);
+        mset->models[0].fl_flash_attn = conf->whisper_flash_attn;
+
+        for(uint32_t i = 0; i < mset->count; i++) {
+            if(switch_file_exists(mset->models[i].file, NULL) != SWITCH_STATUS_SUCCESS) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Model not found: %s\n", mset->models[i].file);
+                switch_goto_status(SWITCH_STATUS_GENERR, out);
+            }
+        }
+    }
+    if(conf->fl_vad_gate && (zstr(conf->vad_gate_model) || switch_file_exists(conf->vad_gate_model, NULL) != SWITCH_STATUS_SUCCESS)) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "VAD model not found: %s (vad-gate disabled)\n", (conf->vad_gate_model ? conf->vad_gate_model : "-"));
+        conf->fl_vad_gate = SWITCH_FALSE;
+    }
+    if(!conf->chunk_time_sec) {
+        conf->chunk_time_sec = DEF_CHUNK_TIME;
+    }
+    if(!conf->partial_interval_ms) {
+        conf->partial_interval_ms = DEF_PARTIAL_INTERVAL;
+    }
+    if(!conf->batch_max_size) {
+        conf->batch_max_size = 1;
+    }
+
+    ncpu = MAX(switch_core_cpu_count(), 1);
+    conf->whisper_n_threads = (conf->whisper_n_threads ? conf->whisper_n_threads : 16);
+    conf->whisper_n_threads = MIN(conf->whisper_n_threads, ncpu);
+    if(conf->fl_remote) {
+        // workers only wait for answers here, several of them share a connection
+        if(mset->count > 1) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "<models> are not used with backend=remote\n");
+        }
+        mset->count = 1;
+        conf->cpu_budget = 0;
+        conf->batch_max_size = 1;
+        conf->remote_connections = (conf->remote_connections ? conf->remote_connections : DEF_REMOTE_CONNECTIONS);
+        conf->remote_timeout_ms = (conf->remote_timeout_ms ? conf->remote_timeout_ms : DEF_REMOTE_TIMEOUT_MS);
+        conf->workers = (conf->workers ? conf->workers : (conf->remote_connections * REMOTE_PIPELINE_DEPTH));
+    } else if(conf->cpu_budget) {
+        conf->cpu_budget = MIN(conf->cpu_budget, ncpu);
+        conf->cpu_min_threads = MIN((conf->cpu_min_threads ? conf->cpu_min_threads : DEF_CPU_MIN_THREADS), conf->cpu_budget);
+        conf->cpu_max_threads = MIN((conf->cpu_max_threads ? conf->cpu_max_threads : conf->cpu_budget), conf->cpu_budget);
+        conf->cpu_max_threads = MAX(conf->cpu_max_threads, conf->cpu_min_threads);
+        conf->workers = (conf->workers ? conf->workers : MAX(conf->cpu_budget / conf->cpu_min_threads, 1));
+    } else {
+        conf->workers = (conf->workers ? conf->workers : MAX(ncpu / conf->whisper_n_threads, 1));
+    }
+
+    if(!zstr(conf->degrade_model) && !(mset->degrade = model_set_lookup(mset, conf->degrade_model))) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "degrade-model: unknown model '%s'\n", conf->degrade_model);
+    }
+
+out:
+    if(xml) {
+        switch_xml_free(xml);
+    }
+    return status;
+}
+
+/* a reload can't resize the threads, pools and connections made at load, these need an unload */
+static void config_check_fixed(globals_t *conf) {
+    const char *name = NULL;
+
+    if(conf->workers != globals.workers) { name = "workers"; }
+    else if(conf->fl_worker_affinity != globals.fl_worker_affinity) { name = "worker-cpu-affinity"; }
+    else if(conf->batch_max_size != globals.batch_max_size) { name = "batch-max-size"; }
+    else if(conf->pool_min != globals.pool_min || conf->pool_max != globals.pool_max || strcmp(conf->pool_rates, globals.pool_rates)) { name = "pool-*"; }
+    else if(conf->arena_max_idle_mb != globals.arena_max_idle_mb) { name = "arena-max-idle-mb"; }
+    else if(conf->fl_vad_gate != globals.fl_vad_gate || conf->vad_gate_threads != globals.vad_gate_threads) { name = "vad-gate"; }
+    else if(!conf->cpu_budget != !globals.cpu_budget) { name = "cpu-budget"; }
+    else if(conf->fl_remote && (conf->remote_connections != globals.remote_connections || strcmp(conf->remote_address, globals.remote_address))) { name = "remote-*"; }
+
+    if(name) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Reload: '%s' changed, it takes effect after an unload only\n", name);
+    }
+}
+
+/* the settings picked up by new calls and the next jobs */
+static void config_apply(globals_t *conf) {
+    switch_mutex_lock(globals.mutex);
+    globals.chunk_time_sec = conf->chunk_time_sec;
+    globals.fl_vad_enabled = conf->fl_vad_enabled;
+    globals.fl_vad_debug = conf->fl_vad_debug;
+    globals.vad_silence_ms = conf->vad_silence_ms;
+    globals.vad_voice_ms = conf->vad_voice_ms;
+    globals.vad_preroll_ms = conf->vad_preroll_ms;
+    globals.vad_recovery_ms = conf->vad_recovery_ms;
+    globals.vad_threshold = conf->vad_threshold;
+    globals.vad_gate_threshold = conf->vad_gate_threshold;
+    switch_copy_string(globals.lang, conf->lang, sizeof(globals.lang));
+    globals.lang_detect_min_p = conf->lang_detect_min_p;
+    globals.lang_detect_max_tries = conf->lang_detect_max_tries;
+    globals.vad_gate_min_speech_ms = conf->vad_gate_min_speech_ms;
+    globals.fl_partial_results = conf->fl_partial_results;
+    globals.partial_interval_ms = conf->partial_interval_ms;
+    globals.fl_pause_discard = conf->fl_pause_discard;
+    globals.fl_result_events = conf->fl_result_events;
+    globals.fl_result_json = conf->fl_result_json;
+    globals.audio_ctx = conf->audio_ctx;
+    globals.audio_ctx_min = conf->audio_ctx_min;
+    globals.audio_ctx_pad = conf->audio_ctx_pad;
+    globals.fl_trim_silence = conf->fl_trim_silence;
+    globals.trim_pad_ms = conf->trim_pad_ms;
+    globals.whisper_max_tokens = conf->whisper_max_tokens;
+    globals.fl_whisper_beam = conf->fl_whisper_beam;
+    globals.whisper_beam_size = conf->whisper_beam_size;
+    globals.whisper_temperature_inc = conf->whisper_temperature_inc;
+    globals.whisper_max_fallbacks = conf->whisper_max_fallbacks;
+    globals.whisper_no_context = conf->whisper_no_context;
+    globals.decode_budget_ms = conf->decode_budget_ms;
+    globals.whisper_use_gpu = conf->whisper_use_gpu;
+    globals.whisper_gpu_dev = conf->whisper_gpu_dev;
+    globals.whisper_flash_attn = conf->whisper_flash_attn;
+    globals.fl_sched_sjf = conf->fl_sched_sjf;
+    globals.sched_cost_weight = conf->sched_cost_weight;
+    globals.sched_max_age_ms = conf->sched_max_age_ms;
+    globals.sched_prio_step_ms = conf->sched_prio_step_ms;
+    globals.sched_deadline_ms = conf->sched_deadline_ms;
+    globals.batch_wait_ms = conf->batch_wait_ms;
+    globals.batch_max_job_smps = conf->batch_max_job_smps;
+    globals.batch_gap_smps = conf->batch_gap_smps;
+    globals.fl_pool_warmup = conf->fl_pool_warmup;
+    globals.fl_model_mmap = conf->fl_model_mmap;
+    globals.fl_model_populate = conf->fl_model_populate;
+    globals.remote_timeout_ms = conf->remote_timeout_ms;
+    globals.admit_max_backlog_ms = conf->admit_max_backlog_ms;
+    globals.admit_max_queue = conf->admit_max_queue;
+    globals.admit_max_wait_ms = conf->admit_max_wait_ms;
+    globals.degrade_backlog_ms = conf->degrade_backlog_ms;
+    // thread budget: per inference threads, or the governor's share when it was on at load
+    globals.whisper_n_threads = conf->whisper_n_threads;
+    if(globals.cpu_budget && conf->cpu_budget) {
+        globals.cpu_budget = conf->cpu_budget;
+        globals.cpu_min_threads = conf->cpu_min_threads;
+        globals.cpu_max_threads = conf->cpu_max_threads;
+    }
+    switch_mutex_unlock(globals.mutex);
+}
+
+/* a new model set and the settings above, calls go on: each session moves over with its next chunk */
+static switch_status_t module_reload(switch_stream_handle_t *stream) {
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+    switch_memory_pool_t *pool = NULL;
+    switch_time_t started = switch_micro_time_now();
+    wasr_model_set_t *mset = NULL;
+    globals_t *conf = NULL;
+
+    if(__atomic_exchange_n(&globals.fl_reloading, SWITCH_TRUE, __ATOMIC_ACQ_REL)) {
+        stream->write_function(stream, "-ERR: reload in progress\n");
+        return SWITCH_STATUS_FALSE;
+    }
+
+    switch_zmalloc(conf, sizeof(globals_t));
+    config_defaults(conf);
+
+    if(switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS || model_set_create(&mset) != SWITCH_STATUS_SUCCESS) {
+        stream->write_function(stream, "-ERR: out of memory\n");
+        switch_goto_status(SWITCH_STATUS_MEMERR, out);
+    }
+    if(config_load(conf, mset, pool) != SWITCH_STATUS_SUCCESS) {
+        stream->write_function(stream, "-ERR: invalid configuration (see the log)\n");
+        switch_goto_status(SWITCH_STATUS_FALSE, out);
+    }
+    if(conf->fl_remote != globals.fl_remote) {
+        stream->write_function(stream, "-ERR: backend can't be changed by a reload\n");
+        switch_goto_status(SWITCH_STATUS_FALSE, out);
+    }
+
+    // the calls keep running on the current set meanwhile
+    if(!globals.fl_remote) {
+        if(model_set_load(mset, conf) != SWITCH_STATUS_SUCCESS) {
+            stream->write_function(stream, "-ERR: unable to load the models (see the log)\n");
+            switch_goto_status(SWITCH_STATUS_FALSE, out);
+        }
+        if(conf->fl_pool_warmup) {
+            model_set_warmup(mset, conf);
+        }
+    }
+
+    config_check_fixed(conf);
+    config_apply(conf);
+
+    model_set_swap(&globals, mset);
+    __atomic_add_fetch(&globals.reloads, 1, __ATOMIC_RELAXED);
+    sess_pool_flush(globals.sess_pool, mset->gen);
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Reloaded: model set #%u (%u models) in %"SWITCH_INT64_T_FMT" ms\n",
+        mset->gen, mset->count, (int64_t)((switch_micro_time_now() - started) / 1000));
+    stream->write_function(stream, "+OK model set #%u\n", mset->gen);
+    mset = NULL;
+
+    sess_pool_fill(globals.sess_pool, &globals);
+out:
+    model_set_release(mset);
+    if(pool) {
+        switch_core_destroy_memory_pool(&pool);
+    }
+    switch_safe_free(conf);
+    __atomic_store_n(&globals.fl_reloading, SWITCH_FALSE, __ATOMIC_RELEASE);
+    return status;
+}
+
+SWITCH_STANDARD_API(whisper_asr_api) {
+    wasr_model_set_t *mset = NULL;
+    char *mycmd = NULL, *argv[4] = { 0 };
+    int argc = 0;
+
+    if(!zstr(cmd) && (mycmd = strdup(cmd))) {
+        argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+    }
+
+    if(argc < 1 || (strcasecmp(argv[0], "status") && strcasecmp(argv[0], "reload"))) {
+        stream->write_function(stream, "-USAGE: %s\n", WHISPER_ASR_API_SYNTAX);
+        goto out;
+    }
+
+    if(!globals.q_jobs || !globals.sess_pool || !globals.arena || !(mset = model_set_acquire(&globals))) {
+        stream->write_function(stream, "-ERR: not ready\n");
+        goto out;
+    }
+
+    if(!strcasecmp(argv[0], "reload")) {
+        module_reload(stream);
+    } else if(argc > 1 && !strcasecmp(argv[1], "json")) {
+        status_print_json(stream, mset);
+    } else {
+        status_print_text(stream, mset);
+    }
+out:
+    model_set_release(mset);
+    switch_safe_free(mycmd);
+    return SWITCH_STATUS_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// main
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+SWITCH_MODULE_LOAD_FUNCTION(mod_whisper_asr_load) {
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+    switch_asr_interface_t *asr_interface;
+    switch_api_interface_t *commands_api_interface;
+    switch_threadattr_t *attr = NULL;
+    switch_thread_t *thread = NULL;
+    wasr_model_set_t *mset = NULL;
+
+    memset(&globals, 0, sizeof(globals));
+    metrics_init(&globals.metrics);
+    config_defaults(&globals);
+    switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, pool);
+    switch_thread_cond_create(&globals.cpu_cond, pool);
+
+    if(model_set_create(&mset) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "model_set_create()\n");
+        switch_goto_status(SWITCH_STATUS_MEMERR, out);
+    }
+    if(config_load(&globals, mset, pool) != SWITCH_STATUS_SUCCESS) {
+        switch_goto_status(SWITCH_STATUS_GENERR, out);
+    }
+
+    if(globals.fl_remote) {
+        if(remote_client_create(&globals.remote, globals.remote_address, globals.remote_connections, globals.remote_timeout_ms, pool) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "remote_client_create()\n");
+            switch_goto_status(SWITCH_STATUS_GENERR, out);
+        }
+    } else if(model_set_load(mset, &globals) != SWITCH_STATUS_SUCCESS) {
+        switch_goto_status(SWITCH_STATUS_GENERR, out);
+    }
+    model_set_swap(&globals, mset);
+    mset = NULL;
+
+    if(jobs_queue_create(&globals.q_jobs, JOBS_QUEUE_SIZE, pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "jobs_queue_create()\n");
+        switch_goto_status(SWITCH_STATUS_GENERR, out);
+    }
+
+    if(switch_event_reserve_subclass(WASR_EVENT_RESULT) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't register subclass %s\n", WASR_EVENT_RESULT);
+        switch_goto_status(SWITCH_STATUS_GENERR, out);
+    }
+
+    if(buf_arena_create(&globals.arena, ((switch_size_t)globals.arena_max_idle_mb << 20), pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "buf_arena_create()\n");
+        switch_goto_status(SWITCH_STATUS_GENERR, out);
     }
-    if(switch_file_exists(globals.model_file, NULL) != SWITCH_STATUS_SUCCESS) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Model not found: %s\n", globals.model_file);
+
+    if(sess_pool_create(&globals.sess_pool, globals.pool_min, globals.pool_max, globals.pool_rates, pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "sess_pool_create()\n");
         switch_goto_status(SWITCH_STATUS_GENERR, out);
     }
-    if(!globals.chunk_time_sec) {
-        globals.chunk_time_sec = DEF_CHUNK_TIME;
+    sess_pool_flush(globals.sess_pool, globals.mset_gen);
+    sess_pool_fill(globals.sess_pool, &globals);
+    if(globals.fl_pool_warmup && !globals.fl_remote) {
+        sess_pool_warmup(globals.sess_pool, &globals);
     }
 
-    globals.whisper_n_threads = (globals.whisper_n_threads ? globals.whisper_n_threads : 16);
+    for(uint32_t i = 0; i < globals.workers; i++) {
+        wasr_worker_t *worker = switch_core_alloc(pool, sizeof(wasr_worker_t));
+
+        worker->id = i;
+        // with the governor the threads of a job vary, so the workers share the budget cores
+        worker->n_threads = (globals.cpu_budget ? globals.cpu_budget : globals.whisper_n_threads);
+        worker->cpu_first = (globals.cpu_budget ? 0 : (i * globals.whisper_n_threads));
+        worker->fl_affinity = globals.fl_worker_affinity;
+
+        switch_mutex_lock(globals.mutex);
+        globals.active_threads++;
+        switch_mutex_unlock(globals.mutex);
+
+        switch_threadattr_create(&attr, pool);
+        switch_threadattr_detach_set(attr, 1);
+        switch_threadattr_stacksize_set(attr, SWITCH_THREAD_STACKSIZE);
+        switch_thread_create(&thread, attr, whisper_worker_thread, worker, pool);
+    }
 
     *module_interface = switch_loadable_module_create_module_interface(pool, modname);
     asr_interface = switch_loadable_module_create_interface(*module_interface, SWITCH_ASR_INTERFACE);
@@ -598,19 +2043,51 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_whisper_asr_load) {
     asr_interface->asr_load_grammar = asr_load_grammar;
     asr_interface->asr_unload_grammar = asr_unload_grammar;
 
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "WhisperASR (%s) [%s]\n", MOD_VERSION, whisper_print_system_info());
-out:
-    if(xml) {
-        switch_xml_free(xml);
+    SWITCH_ADD_API(commands_api_interface, "whisper_asr", "whisper_asr status/reload", whisper_asr_api, WHISPER_ASR_API_SYNTAX);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "WhisperASR (%s) [%s]\n", MOD_VERSION, (globals.fl_remote ? "remote" : whisper_print_system_info()));
+    if(globals.fl_remote) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Remote backend: %s (%u connections, %u workers)\n",
+            globals.remote_address, globals.remote_connections, globals.workers);
+    } else if(globals.cpu_budget) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Inference workers: %u, cpu budget: %u (%u..%u threads per job)\n",
+            globals.workers, globals.cpu_budget, globals.cpu_min_threads, globals.cpu_max_threads);
+    } else {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Inference workers: %u x %u threads\n", globals.workers, globals.whisper_n_threads);
+    }
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Session pool: %u ready (min=%u, max=%u, rates=%s)\n",
+        globals.sess_pool->size, globals.sess_pool->min, globals.sess_pool->max, globals.pool_rates);
+    if(globals.batch_max_size > 1) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Batching: up to %u utterances, wait %u ms\n", globals.batch_max_size, globals.batch_wait_ms);
+    }
+    if(!globals.fl_remote) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Models: %u loaded in %"SWITCH_UINT64_T_FMT" ms (%s)\n",
+            globals.mset->count, (globals.mset->load_us / 1000), (globals.fl_model_mmap ? "mmap" : "file"));
     }
+    for(uint32_t i = 1; i < globals.mset->count; i++) {
+        wasr_model_t *model = &globals.mset->models[i];
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Model %s: %s (up to %u ms, langs: %s)\n",
+            model->name, model->file, model->max_ms, (model->langs ? model->langs : "any"));
+    }
+    if(globals.fl_vad_gate) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "VAD gate: %s (threshold=%.2f, min-speech=%u ms)\n",
+            globals.vad_gate_model, globals.vad_gate_threshold, globals.vad_gate_min_speech_ms);
+    }
+out:
+    model_set_release(mset);
     return status;
 }
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_whisper_asr_shutdown) {
+    wasr_model_set_t *mset = NULL;
     uint8_t fl_wloop = SWITCH_TRUE;
 
     globals.fl_shutdown = SWITCH_TRUE;
 
+    if(globals.q_jobs) {
+        jobs_queue_interrupt_all(globals.q_jobs);
+    }
+
     switch_mutex_lock(globals.mutex);
     fl_wloop = (globals.active_threads > 0);
     switch_mutex_unlock(globals.mutex);
@@ -625,5 +2102,37 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_whisper_asr_shutdown) {
         }
     }
 
+    if(globals.q_jobs) {
+        void *pop = NULL;
+        while(jobs_queue_trypop(globals.q_jobs, &pop) == SWITCH_STATUS_SUCCESS) {
+            if(pop) { asr_ctx_release((wasr_ctx_t *)pop); }
+        }
+    }
+
+    if(globals.metrics.batch_runs) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Batching: runs=%"SWITCH_UINT64_T_FMT", jobs=%"SWITCH_UINT64_T_FMT", fill=%.2f\n",
+            globals.metrics.batch_runs, globals.metrics.batch_jobs, metrics_batch_fill(&globals.metrics, globals.batch_max_size));
+    }
+
+    if(globals.remote) {
+        remote_client_shutdown(globals.remote);
+    }
+
+    if(globals.sess_pool) {
+        sess_pool_destroy(globals.sess_pool);
+    }
+
+    if(globals.arena) {
+        buf_arena_destroy(globals.arena);
+    }
+
+    switch_mutex_lock(globals.mutex);
+    mset = globals.mset;
+    globals.mset = NULL;
+    switch_mutex_unlock(globals.mutex);
+    model_set_release(mset);
+
+    switch_event_free_subclass(WASR_EVENT_RESULT);
+
     return SWITCH_STATUS_SUCCESS;
 }
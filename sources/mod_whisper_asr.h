@@ -25,6 +25,7 @@
 #include <switch.h>
 #include <speex/speex_resampler.h>
 #include <whisper.h>
+#include "proto.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -33,76 +34,547 @@
 #define MOD_VERSION             "1.1_19062024"
 
 #define DEF_CHUNK_TIME          15 // sec
+#define DEF_PARTIAL_INTERVAL    500 // ms
 #define QUEUE_SIZE              32
-#define VAD_STORE_FRAMES        32
-#define VAD_RECOVERY_FRAMES     15
+#define DEF_VAD_PREROLL_MS      100
+#define DEF_LANG                "en"
+#define LANG_AUTO               "auto"
+#define DEF_LANG_DETECT_MIN_P   0.5f
+#define DEF_LANG_DETECT_TRIES   3
+#define DEF_BEAM_SIZE           5
+#define DEF_TEMPERATURE_INC     0.2f
+#define DEF_MAX_FALLBACKS       5
+#define JOBS_QUEUE_SIZE         1024
+#define WORKER_IDLE_TIMEOUT     1000000 // usec
+#define RESAMPLE_BLOCK_SIZE     1024 // samples
+#define I2F_SCALE               (1.0f / 32768.0f)
+#define AUDIO_CTX_AUTO          -1
+#define AUDIO_CTX_FRAMES_SEC    50  // encoder frames per second (1500 per 30 sec)
+#define DEF_AUDIO_CTX_MIN       128
+#define DEF_AUDIO_CTX_PAD       64
+#define TRIM_WINDOW_MS          10
+#define DEF_TRIM_PAD_MS         150
+#define DEF_BATCH_WAIT_MS       30
+#define DEF_BATCH_MAX_JOB_MS    5000
+#define DEF_BATCH_GAP_MS        1000
+#define DEF_SCHED_COST_WEIGHT   200  // ms of queueing penalty per second of audio
+#define DEF_SCHED_MAX_AGE_MS    2000
+#define DEF_SCHED_PRIO_STEP_MS  250
+#define BATCH_MAX_SAMPLES       (WHISPER_SAMPLE_RATE * 30) // whisper window
+#define DEF_CPU_MIN_THREADS     2
+#define DEF_POOL_MIN            2
+#define DEF_POOL_MAX            32
+#define DEF_POOL_RATES          "8000,16000"
+#define POOL_RATES_MAX          8
+#define WARMUP_AUDIO_MS         1000
+#define BUF_ARENA_MIN_SHIFT     16  // smallest size class: 64 KB
+#define BUF_ARENA_CLASSES       9   // up to 16 MB, larger blocks bypass the arena
+#define DEF_ARENA_MAX_IDLE_MB   64
+#define DEF_VAD_GATE_THRESHOLD  0.5f
+#define DEF_VAD_GATE_MIN_SPEECH 250 // ms
+#define DEF_VAD_GATE_THREADS    1
+#define MODELS_MAX              8   // the default one + named ones from <models>
+#define LOAD_RELEASE_PCT        80  // a load state is left under this share of its watermark
+#define DEF_REMOTE_CONNECTIONS  2
+#define DEF_REMOTE_TIMEOUT_MS   30000
+#define REMOTE_PIPELINE_DEPTH   8   // default workers per connection in remote mode
+#define REMOTE_RETRY_MS         1000
+#define REMOTE_CANCELS_MAX      64  // CANCELs waiting for the connection's send lock
+
+/* lock-free log2 histogram of usec values, bucket i holds [2^(i-1), 2^i) */
+#define METRICS_HIST_BUCKETS    28
+/* governor decisions by granted thread count, the last slot takes the rest */
+#define METRICS_THREAD_SLOTS    33
+
+typedef enum {
+    METRICS_STAGE_QUEUE = 0,    // submit -> worker pop
+    METRICS_STAGE_CONVERT,      // ring -> float (resample/normalize/trim)
+    METRICS_STAGE_VAD,          // neural vad gate
+    METRICS_STAGE_ENCODE,
+    METRICS_STAGE_DECODE,
+    METRICS_STAGE_INFERENCE,    // whole whisper_full
+    METRICS_STAGE_TOTAL,        // vad stop -> final result
+    METRICS_STAGE_MAX
+} metrics_stage_t;
+
+typedef enum {
+    LOAD_STATE_NORMAL = 0,
+    LOAD_STATE_DEGRADED,        // degrade-model for new jobs, no partials
+    LOAD_STATE_OVERLOADED       // and asr_open refuses new sessions
+} load_state_t;
+
+typedef struct {
+    uint64_t                buckets[METRICS_HIST_BUCKETS];
+    uint64_t                count;
+    uint64_t                sum;
+    uint64_t                max;
+} metrics_hist_t;
+
+typedef struct {
+    metrics_hist_t          stages[METRICS_STAGE_MAX];
+    switch_time_t           started;
+    uint64_t                audio_us;       // transcribed audio
+    uint64_t                inference_us;
+    uint64_t                busy_us;        // sum over workers
+    uint64_t                jobs;
+    uint64_t                jobs_rejected;
+    uint64_t                jobs_cancelled;     // result thrown away: hangup or pause-discard
+    uint64_t                inferences_aborted; // stopped by the abort callback before the end
+    uint64_t                results;
+    uint64_t                partials;
+    uint64_t                lang_detections;    // lang=auto detection passes
+    uint64_t                lang_locked;        // sessions that kept a detected language
+    uint64_t                decode_fallbacks;   // temperature fallback passes
+    uint64_t                decode_budget_hits; // inferences cut short by decode-budget-ms
+    uint64_t                dropped_smps;
+    uint64_t                discarded_smps;     // buffered audio dropped by pause-discard
+    uint64_t                vad_gated;          // jobs without speech, never transcribed
+    uint64_t                vad_skipped_us;     // their audio
+    uint64_t                vad_trimmed_us;     // non-speech cut off the jobs that went on
+    uint64_t                sessions_refused;   // asr_open while overloaded
+    uint64_t                jobs_degraded;      // sent to degrade-model
+    uint64_t                partials_skipped;   // while degraded
+    uint64_t                results_dropped;    // session results queue full
+    uint64_t                batch_runs;         // packed runs of final chunks
+    uint64_t                batch_jobs;         // jobs in them, fill = jobs / (runs * batch-max-size)
+    uint64_t                sessions_total;
+    uint32_t                sessions_active;
+    uint64_t                threads_granted[METRICS_THREAD_SLOTS];
+    uint64_t                threads_sum;
+    uint64_t                threads_grants;
+    uint64_t                threads_clamped;    // got less than the fair share, budget in use
+    uint64_t                threads_waited;     // held back until cpu-min-threads were free
+} metrics_t;
+
+/* jobs queue ordered by key (lowest first), FIFO among equal keys */
+typedef struct {
+    void                    *data;
+    int64_t                 key;
+    uint64_t                seq;
+} jobs_queue_entry_t;
+
+typedef struct {
+    switch_mutex_t          *mutex;
+    switch_thread_cond_t    *cond;
+    jobs_queue_entry_t      *heap;
+    uint32_t                size;
+    uint32_t                capacity;
+    uint64_t                seq;
+    uint8_t                 fl_interrupted;
+} jobs_queue_t;
+
+/* power of two size classes shared by all sessions, blocks are kept on per class free lists up to max_idle bytes */
+typedef struct {
+    switch_mutex_t          *mutex;
+    void                    *free[BUF_ARENA_CLASSES];
+    uint32_t                free_count[BUF_ARENA_CLASSES];
+    switch_size_t           max_idle;
+    switch_size_t           idle_bytes;
+    switch_size_t           used_bytes;
+    switch_size_t           used_peak;
+    uint64_t                allocs;
+    uint64_t                reuses;
+} buf_arena_t;
+
+/* a transcription waiting for its answer from whisper_asr_worker */
+typedef struct remote_req_s {
+    struct remote_req_s     *next;
+    struct wasr_job_s       *job;
+    switch_buffer_t         *text_buffer;
+    switch_status_t         status;
+    uint32_t                id;
+    uint8_t                 fl_done;
+} remote_req_t;
+
+typedef struct {
+    switch_mutex_t          *mutex;         // fd, pending list
+    switch_mutex_t          *send_mutex;
+    switch_thread_cond_t    *cond;
+    remote_req_t            *pending;
+    uint32_t                pending_count;
+    uint32_t                cancels[REMOTE_CANCELS_MAX];    // request ids, sent by the next holder of send_mutex
+    uint32_t                cancels_count;
+    switch_time_t           retry_ts;
+    int                     fd;
+    uint8_t                 fl_reader;
+} remote_conn_t;
+
+typedef struct {
+    switch_memory_pool_t    *pool;
+    remote_conn_t           *conns;
+    const char              *address;
+    uint32_t                conns_count;
+    uint32_t                timeout_ms;
+    uint32_t                next_id;
+    uint32_t                readers;
+    uint64_t                requests;
+    uint64_t                errors;
+    uint64_t                connects;
+    uint8_t                 fl_shutdown;
+} remote_client_t;
+
+/*
+ * a loaded model and its routing rule: chunks up to max_ms and/or in one of 'langs' go to it
+ * (first match in config order), a model without a rule is only taken by the per call model= param.
+ * models[0] is the 'model' setting, it gets whatever no rule took.
+ */
+typedef struct {
+    const char              *name;
+    const char              *file;
+    const char              *langs;     // comma separated
+    struct whisper_context  *wctx;
+    uint32_t                max_ms;
+    uint32_t                n_threads;  // 0 = whisper-n-threads (ignored under the cpu governor)
+    uint8_t                 fl_flash_attn;
+    uint64_t                file_size;
+    uint64_t                load_us;
+    uint64_t                routed;
+    uint64_t                forced;     // by the model= param
+    uint64_t                audio_us;
+    uint64_t                inference_us;
+} wasr_model_t;
+
+/*
+ * the models of one (re)load, swapped as a whole by 'whisper_asr reload'. references are held by the
+ * session states made from models[0], the workers' states of the others and globals while it is current.
+ */
+typedef struct {
+    switch_memory_pool_t    *pool;      // names, files, langs
+    wasr_model_t            models[MODELS_MAX];
+    uint32_t                count;
+    uint32_t                refs;
+    uint32_t                gen;
+    uint64_t                load_us;
+    wasr_model_t            *degrade;   // degrade-model, NULL = none
+} wasr_model_set_t;
+
+/* per session resources that are expensive to set up, recycled between calls */
+typedef struct {
+    struct whisper_state    *wstate;
+    wasr_model_set_t        *mset;      // the set wstate was made for
+    switch_vad_t            *vad;
+    SpeexResamplerState     *resampler;
+    uint32_t                samplerate;
+} sess_res_t;
 
 typedef struct {
     switch_mutex_t          *mutex;
+    sess_res_t              **items;
+    uint32_t                size;
+    uint32_t                min;
+    uint32_t                max;
+    uint32_t                rates[POOL_RATES_MAX];
+    uint32_t                rates_count;
+    uint32_t                rates_next;
+    uint32_t                created;    // currently allocated, pooled or in use
+    uint32_t                gen;        // model set of the idle items, older ones are dropped
+    uint64_t                hits;
+    uint64_t                misses;     // acquire had to create a fresh state
+} sess_pool_t;
+
+typedef struct {
+    switch_mutex_t          *mutex;
+    struct whisper_context  *wctx;      // whisper_asr_worker's model, the module goes through mset
+    wasr_model_set_t        *mset;      // current one, take it with model_set_acquire()
+    uint32_t                mset_gen;
+    uint32_t                reloads;
+    int64_t                 backlog_us;     // audio buffered in all sessions and not transcribed yet
+    uint64_t                queue_wait_us;  // smoothed
+    uint32_t                load_state;
+    uint32_t                admit_max_backlog_ms;
+    uint32_t                admit_max_queue;
+    uint32_t                admit_max_wait_ms;
+    uint32_t                degrade_backlog_ms;
+    const char              *degrade_model; // resolved into the model set by config_load, the string goes with the reload pool
+    sess_pool_t             *sess_pool;
+    buf_arena_t             *arena;
+    remote_client_t         *remote;
+    const char              *remote_address;
+    uint32_t                remote_connections;
+    uint32_t                remote_timeout_ms;
+    jobs_queue_t            *q_jobs;
     const char              *model_file;
     uint32_t                active_threads;
+    uint64_t                idle_wakeups;
+    metrics_t               metrics;
     uint32_t                chunk_time_sec;
-    uint32_t                whisper_threads;
+    uint32_t                workers;
     uint32_t                whisper_tokens;
     uint32_t                vad_silence_ms;
     uint32_t                vad_voice_ms;
+    uint32_t                vad_preroll_ms;
+    uint32_t                vad_recovery_ms;    // 0 = vad_voice_ms
     uint32_t                vad_threshold;
+    uint32_t                partial_interval_ms;
+    int32_t                 audio_ctx;
+    uint32_t                audio_ctx_min;
+    uint32_t                audio_ctx_pad;
+    uint32_t                trim_pad_ms;
+    uint32_t                batch_max_size;
+    uint32_t                batch_wait_ms;
+    uint32_t                batch_max_job_smps;
+    uint32_t                batch_gap_smps;
+    uint32_t                sched_cost_weight;
+    uint32_t                sched_max_age_ms;
+    uint32_t                sched_prio_step_ms;
+    uint32_t                sched_deadline_ms;
+    const char              *pool_rates;
+    uint32_t                pool_min;
+    uint32_t                pool_max;
+    uint32_t                arena_max_idle_mb;
+    const char              *vad_gate_model;
+    float                   vad_gate_threshold;
+    float                   lang_detect_min_p;
+    uint32_t                lang_detect_max_tries;
+    char                    lang[8];        // default for new calls, auto = detected per call
+    uint32_t                vad_gate_min_speech_ms;
+    uint32_t                vad_gate_threads;
+    uint32_t                cpu_budget;         // 0 = fixed whisper-n-threads per inference
+    uint32_t                cpu_min_threads;
+    uint32_t                cpu_max_threads;
+    uint32_t                cpu_in_use;
+    uint32_t                cpu_running;
+    switch_thread_cond_t    *cpu_cond;          // signalled when threads go back to the budget
+    uint8_t                 fl_sched_sjf;
+    uint8_t                 fl_pool_warmup;
+    uint8_t                 fl_model_mmap;
+    uint8_t                 fl_model_populate;
+    uint8_t                 fl_remote;
+    uint8_t                 fl_trim_silence;
     uint8_t                 fl_vad_enabled;
     uint8_t                 fl_vad_debug;
+    uint8_t                 fl_vad_gate;
+    uint8_t                 fl_worker_affinity;
+    uint8_t                 fl_partial_results;
+    uint8_t                 fl_pause_discard;
+    uint8_t                 fl_result_events;   // CUSTOM whisper_asr::result per result
+    uint8_t                 fl_result_json;     // asr_get_results gives json instead of text
+    uint8_t                 fl_whisper_beam;    // beam search instead of greedy sampling
+    uint8_t                 fl_reloading;
     uint8_t                 fl_shutdown;
     //
     uint32_t                whisper_n_threads;
     uint32_t                whisper_max_tokens;
+    uint32_t                whisper_beam_size;      // with fl_whisper_beam
+    uint32_t                whisper_max_fallbacks;
+    float                   whisper_temperature_inc;
+    uint32_t                whisper_no_context;
+    uint32_t                decode_budget_ms;       // 0 = no limit
     uint32_t                whisper_flash_attn;
     uint32_t                whisper_use_gpu;
     uint32_t                whisper_gpu_dev;
 } globals_t;
 
+/* single-producer/single-consumer ring of int16 samples (media thread -> worker) */
+typedef struct {
+    int16_t                 *data;
+    uint32_t                size;
+    uint32_t                mask;
+    uint32_t                head;
+    uint32_t                tail;
+    uint32_t                overflows;
+} audio_ring_t;
+
 typedef struct {
     switch_vad_t            *vad;
     switch_vad_state_t      vad_state;
-    switch_buffer_t         *vad_buffer;
     switch_mutex_t          *mutex;
-    switch_queue_t          *q_audio;
+    switch_thread_cond_t    *cond;      // signalled when the last worker reference goes
     switch_queue_t          *q_text;
     SpeexResamplerState     *resampler;
-    struct whisper_context  *wctx;
+    sess_res_t              *res;       // its wstate follows the model set across reloads
+    char                    *model;     // model= param, NULL = routed per job
     char                    *lang;
+    char                    *uuid;      // channel-uuid param, for the events
+    char                    lang_detected[8];   // lang=auto, 'lang' points here once it is locked
+    uint32_t                lang_detect_tries;
+    audio_ring_t            audio_ring;
+    audio_ring_t            vad_history;    // the last pre-roll + recovery before the speech, media thread only
     int32_t                 transcript_results;
-    int32_t                 vad_buffer_offs;
-    uint32_t                vad_buffer_size;
-    uint32_t                vad_stored_frames;
-    uint32_t                chunk_buffer_size;
+    uint32_t                vad_preroll_ms;
+    uint32_t                vad_recovery_ms;
+    uint32_t                chunk_samples;
+    uint32_t                ring_samples;
     uint32_t                refs;
+    uint32_t                cancel_gen; // bumped on cancel, jobs taken under an older one are dropped
+    uint32_t                discard_head;
+    int64_t                 backlog_us; // this session's share of globals.backlog_us
+    uint32_t                wakeups;
+    uint32_t                overflows_seen;
+    switch_time_t           queued_ts;
+    switch_time_t           flush_ts;
+    uint32_t                partial_smps;
+    uint32_t                partial_interval_smps;
+    int32_t                 audio_ctx;
+    int32_t                 priority;
+    uint32_t                deadline_ms;
     uint32_t                samplerate;
     uint32_t                channels;
-    uint32_t                frame_len;
     uint8_t                 fl_pause;
     uint8_t                 fl_vad_enabled;
-    uint8_t                 fl_vad_first_cycle;
+    uint8_t                 fl_vad_gate;
     uint8_t                 fl_destroyed;
     uint8_t                 fl_abort;
+    uint8_t                 fl_discard; // ring audio up to discard_head is to be dropped by its consumer
+    uint8_t                 fl_pause_discard;
+    uint8_t                 fl_result_events;
+    uint8_t                 fl_result_json;
+    uint8_t                 fl_flush;
+    uint8_t                 fl_job_queued;
+    uint8_t                 fl_partial;
+    uint8_t                 fl_partial_req;
+    uint8_t                 fl_partial_reset;   // set by the worker, partial_smps is zeroed by the media thread
+    uint8_t                 fl_trim_silence;
     //
     uint32_t                whisper_max_tokens;
     uint32_t                whisper_translate;
     uint32_t                whisper_single_segment;
+    uint32_t                whisper_beam_size;      // 0 = greedy
+    uint32_t                whisper_max_fallbacks;
+    float                   whisper_temperature_inc;
+    uint32_t                whisper_no_context;
+    uint32_t                decode_budget_ms;
 } wasr_ctx_t;
 
+#define WASR_EVENT_RESULT           "whisper_asr::result"
+
+#define XDATA_FLAG_PARTIAL          (1 << 0)
+#define XDATA_FLAG_BEGIN_SPEAKING   (1 << 1)
+
 typedef struct {
     uint32_t                len;
+    uint32_t                flags;
     switch_byte_t           *data;
 } xdata_buffer_t;
 
+/* a transcribed segment, times in ms from the start of the chunk */
+typedef struct {
+    int64_t                 t0;
+    int64_t                 t1;
+    double                  p;          // average token probability
+    const char              *lang;
+    const char              *text;
+} wasr_segment_t;
+
+typedef struct wasr_job_s {
+    wasr_ctx_t              *asr_ctx;
+    wasr_model_t            *model;
+    struct whisper_context  *wctx;
+    struct whisper_state    *wstate;
+    switch_buffer_t         *text_buffer;
+    float                   *buffer;    // arena block, returned once the job is done
+    float                   *audio;
+    uint32_t                samples;
+    uint32_t                offset;     // position in the packed batch buffer
+    switch_time_t           flush_ts;
+    uint64_t                queue_us;
+    uint64_t                inference_us;
+    int32_t                 lang_id;    // detected for lang=auto, -1 = not run
+    float                   lang_p;
+    uint32_t                cancel_gen; // session cancel_gen when the job was taken
+    uint8_t                 fl_final;
+} wasr_job_t;
+
+typedef struct {
+    uint32_t                id;
+    uint32_t                n_threads;
+    uint32_t                cpu_first;
+    uint8_t                 fl_affinity;
+    struct whisper_vad_context *vctx;   // per worker, the vad model keeps state while it runs
+    wasr_model_set_t        *mset;      // the set of wstates
+    struct whisper_state    *wstates[MODELS_MAX];   // for models other than the default one
+    wasr_job_t              *jobs;
+    switch_buffer_t         **text_buffers;
+    float                   *pack_buffer;
+} wasr_worker_t;
+
 /* utils.c */
 uint32_t asr_ctx_take(wasr_ctx_t *asr_ctx);
 void asr_ctx_release(wasr_ctx_t *asr_ctx);
+uint8_t job_cancelled(wasr_job_t *job);
 
 switch_status_t xdata_buffer_push(switch_queue_t *queue, switch_byte_t *data, uint32_t data_len);
 switch_status_t xdata_buffer_alloc(xdata_buffer_t **out, switch_byte_t *data, uint32_t data_len);
 void xdata_buffer_free(xdata_buffer_t **buf);
 void xdata_buffer_queue_clean(switch_queue_t *queue);
 
-switch_status_t transcribe(wasr_ctx_t *ast_ctx, float *audio, uint32_t samples, switch_buffer_t *text_buffer, globals_t *globals);
-void i2f(int16_t *in, float *out, uint32_t samples);
+switch_status_t transcribe(wasr_job_t *job, uint32_t n_threads, globals_t *globals);
+uint8_t decode_params_equal(wasr_ctx_t *a, wasr_ctx_t *b);
+uint8_t segment_parse(char **cursor, wasr_segment_t *seg);
+uint32_t jobs_pack(wasr_job_t *jobs, uint32_t count, float *buffer, uint32_t gap_smps);
+switch_status_t transcribe_batch(wasr_job_t *jobs, uint32_t count, float *audio, uint32_t samples, uint32_t n_threads, globals_t *globals);
+void i2f(const int16_t *in, float *out, uint32_t samples);
+uint32_t trim_silence(const float *audio, uint32_t samples, uint32_t threshold, uint32_t pad_ms, uint32_t *offset);
+uint32_t vad_gate(struct whisper_vad_context *vctx, const float *audio, uint32_t samples, float threshold, uint32_t min_speech_ms, uint32_t pad_ms, uint32_t *offset);
+int32_t audio_ctx_calc(int32_t audio_ctx, uint32_t samples, uint32_t ctx_min, uint32_t ctx_pad, int32_t ctx_max);
+int32_t audio_ctx_parse(const char *val);
+uint32_t resample_to_float(SpeexResamplerState *resampler, const int16_t *in, uint32_t in_smps, float *out, uint32_t out_max);
+
+switch_status_t audio_ring_init(audio_ring_t *ring, int16_t *data, uint32_t samples);
+uint32_t audio_ring_write(audio_ring_t *ring, const int16_t *data, uint32_t samples);
+void audio_ring_write_over(audio_ring_t *ring, const int16_t *data, uint32_t samples);
+uint32_t audio_ring_used(audio_ring_t *ring);
+uint32_t audio_ring_peek(audio_ring_t *ring, uint32_t samples, int16_t **p1, uint32_t *l1, int16_t **p2, uint32_t *l2);
+void audio_ring_consume(audio_ring_t *ring, uint32_t samples);
+
+switch_status_t jobs_queue_create(jobs_queue_t **queue, uint32_t capacity, switch_memory_pool_t *pool);
+switch_status_t jobs_queue_push(jobs_queue_t *queue, void *data, int64_t key);
+switch_status_t jobs_queue_pop_timeout(jobs_queue_t *queue, void **data, switch_interval_time_t timeout);
+switch_status_t jobs_queue_trypop(jobs_queue_t *queue, void **data);
+switch_status_t jobs_queue_remove(jobs_queue_t *queue, void *data);
+uint32_t jobs_queue_size(jobs_queue_t *queue);
+void jobs_queue_interrupt_all(jobs_queue_t *queue);
+
+switch_status_t sess_pool_create(sess_pool_t **out, uint32_t min, uint32_t max, const char *rates, switch_memory_pool_t *pool);
+void sess_pool_destroy(sess_pool_t *sess_pool);
+void sess_pool_fill(sess_pool_t *sess_pool, globals_t *globals);
+sess_res_t *sess_pool_acquire(sess_pool_t *sess_pool, uint32_t samplerate, globals_t *globals);
+void sess_pool_release(sess_pool_t *sess_pool, sess_res_t *res);
+void sess_pool_warmup(sess_pool_t *sess_pool, globals_t *globals);
+void sess_pool_flush(sess_pool_t *sess_pool, uint32_t gen);
+switch_status_t sess_res_rebind(sess_res_t *res, globals_t *globals);
+
+struct whisper_context *model_load(wasr_model_t *model, struct whisper_context_params cparams, uint8_t fl_mmap, uint8_t fl_populate);
+switch_status_t proc_mem_stat(uint64_t *rss, uint64_t *file);
+switch_status_t model_set_create(wasr_model_set_t **out);
+switch_status_t model_set_load(wasr_model_set_t *mset, globals_t *globals);
+void model_set_warmup(wasr_model_set_t *mset, globals_t *globals);
+wasr_model_set_t *model_set_acquire(globals_t *globals);
+void model_set_ref(wasr_model_set_t *mset);
+void model_set_release(wasr_model_set_t *mset);
+void model_set_swap(globals_t *globals, wasr_model_set_t *mset);
+wasr_model_t *model_set_lookup(wasr_model_set_t *mset, const char *name);
+
+switch_status_t buf_arena_create(buf_arena_t **out, switch_size_t max_idle, switch_memory_pool_t *pool);
+void buf_arena_destroy(buf_arena_t *arena);
+void *buf_arena_alloc(buf_arena_t *arena, switch_size_t size);
+void buf_arena_free(buf_arena_t *arena, void *ptr);
+switch_size_t buf_arena_block_size(void *ptr);
+uint32_t audio_ring_size(uint32_t samples);
+
+switch_status_t thread_set_affinity(uint32_t cpu_first, uint32_t cpu_count);
+uint32_t cpu_governor_acquire(globals_t *globals);
+void cpu_governor_release(globals_t *globals, uint32_t n_threads);
+
+/* remote.c */
+switch_status_t remote_client_create(remote_client_t **out, const char *address, uint32_t connections, uint32_t timeout_ms, switch_memory_pool_t *pool);
+void remote_client_shutdown(remote_client_t *client);
+switch_status_t remote_transcribe(remote_client_t *client, wasr_job_t *job, globals_t *globals);
+void remote_client_cancel(remote_client_t *client, wasr_ctx_t *asr_ctx);
+uint32_t remote_client_connected(remote_client_t *client);
+uint32_t remote_client_in_flight(remote_client_t *client);
+
+/* metrics.c */
+void metrics_init(metrics_t *metrics);
+void metrics_hist_add(metrics_hist_t *hist, uint64_t usec);
+void metrics_add(uint64_t *counter, uint64_t val);
+double metrics_batch_fill(metrics_t *metrics, uint32_t batch_max_size);
+uint64_t metrics_hist_percentile(metrics_hist_t *hist, double p);
+const char *metrics_stage_name(metrics_stage_t stage);
+void metrics_print_stages(metrics_t *metrics, switch_stream_handle_t *stream);
+cJSON *metrics_stages_json(metrics_t *metrics);
+void metrics_threads_add(metrics_t *metrics, uint32_t n_threads, uint8_t fl_clamped);
+void metrics_print_threads(metrics_t *metrics, switch_stream_handle_t *stream);
+cJSON *metrics_threads_json(metrics_t *metrics);
 
 #endif
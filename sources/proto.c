@@ -0,0 +1,197 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ *
+ */
+#include "proto.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t               addr_len;
+    int                     family;
+} proto_addr_t;
+
+static switch_status_t proto_addr_parse(const char *address, proto_addr_t *out) {
+    memset(out, 0, sizeof(*out));
+
+    if(zstr(address)) {
+        return SWITCH_STATUS_FALSE;
+    }
+
+    if(!strncasecmp(address, "unix:", 5)) {
+        struct sockaddr_un *sun = (struct sockaddr_un *)&out->addr;
+        const char *path = address + 5;
+
+        if(zstr(path) || strlen(path) >= sizeof(sun->sun_path)) {
+            return SWITCH_STATUS_FALSE;
+        }
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, path);
+        out->addr_len = sizeof(struct sockaddr_un);
+        out->family = AF_UNIX;
+    } else {
+        struct addrinfo hints = { 0 }, *res = NULL;
+        char host[256] = { 0 };
+        const char *hp = (!strncasecmp(address, "tcp:", 4) ? address + 4 : address);
+        const char *port = strrchr(hp, ':');
+
+        if(!port || port == hp || (size_t)(port - hp) >= sizeof(host)) {
+            return SWITCH_STATUS_FALSE;
+        }
+        memcpy(host, hp, (port - hp));
+
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if(getaddrinfo(host, port + 1, &hints, &res) != 0 || !res) {
+            return SWITCH_STATUS_FALSE;
+        }
+        memcpy(&out->addr, res->ai_addr, res->ai_addrlen);
+        out->addr_len = res->ai_addrlen;
+        out->family = res->ai_family;
+        freeaddrinfo(res);
+    }
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+int proto_connect(const char *address, uint32_t timeout_ms) {
+    struct timeval tv = { .tv_sec = (timeout_ms / 1000), .tv_usec = ((timeout_ms % 1000) * 1000) };
+    proto_addr_t pa;
+    int fd = -1, on = 1;
+
+    if(proto_addr_parse(address, &pa) != SWITCH_STATUS_SUCCESS) {
+        return -1;
+    }
+    if((fd = socket(pa.family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        return -1;
+    }
+
+    // bounds connect() and the sends, the reads block until the peer answers or goes away
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if(pa.family != AF_UNIX) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    if(connect(fd, (struct sockaddr *)&pa.addr, pa.addr_len) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int proto_listen(const char *address) {
+    proto_addr_t pa;
+    int fd = -1, on = 1;
+
+    if(proto_addr_parse(address, &pa) != SWITCH_STATUS_SUCCESS) {
+        return -1;
+    }
+    if((fd = socket(pa.family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        return -1;
+    }
+
+    if(pa.family == AF_UNIX) {
+        unlink(((struct sockaddr_un *)&pa.addr)->sun_path);
+    } else {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+
+    if(bind(fd, (struct sockaddr *)&pa.addr, pa.addr_len) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void proto_close(int fd) {
+    if(fd >= 0) {
+        shutdown(fd, SHUT_RDWR);
+        close(fd);
+    }
+}
+
+void proto_hdr_init(wasr_msg_hdr_t *hdr, uint8_t type, uint16_t flags, uint32_t id, uint32_t len) {
+    hdr->magic = WASR_PROTO_MAGIC;
+    hdr->version = WASR_PROTO_VERSION;
+    hdr->type = type;
+    hdr->flags = flags;
+    hdr->id = id;
+    hdr->len = len;
+}
+
+switch_status_t proto_hdr_check(wasr_msg_hdr_t *hdr) {
+    if(hdr->magic != WASR_PROTO_MAGIC || hdr->version != WASR_PROTO_VERSION || hdr->len > WASR_PROTO_MAX_PAYLOAD) {
+        return SWITCH_STATUS_FALSE;
+    }
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t proto_sendv(int fd, struct iovec *iov, int iovcnt) {
+    struct msghdr msg = { 0 };
+
+    while(iovcnt > 0) {
+        ssize_t n = 0;
+
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        if((n = sendmsg(fd, &msg, MSG_NOSIGNAL)) < 0) {
+            if(errno == EINTR) { continue; }
+            return SWITCH_STATUS_FALSE;
+        }
+
+        while(iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++; iovcnt--;
+        }
+        if(iovcnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t proto_recv(int fd, void *buf, size_t len) {
+    uint8_t *p = (uint8_t *)buf;
+
+    while(len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            return SWITCH_STATUS_FALSE;
+        }
+        p += n; len -= n;
+    }
+
+    return SWITCH_STATUS_SUCCESS;
+}
@@ -0,0 +1,85 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ *
+ */
+#ifndef WASR_PROTO_H
+#define WASR_PROTO_H
+
+#include <switch.h>
+#include <sys/uio.h>
+
+/*
+ * module <-> whisper_asr_worker framing, every message is a header followed by 'len' bytes of payload.
+ * fields are in host byte order, both ends are expected to be little-endian.
+ * many requests can be in flight on one connection, responses come back by 'id' in any order.
+ *
+ *  TRANSCRIBE  : wasr_msg_transcribe_t + float32[samples] (16 kHz mono)
+ *  RESULT      : utf-8, one line per segment: t0_ms \t t1_ms \t avg token p \t lang \t text (see segment_write)
+ *  ERROR       : utf-8 reason
+ *  CANCEL      : no payload, 'id' is the request to drop (the answer to it may still come and is ignored)
+ */
+#define WASR_PROTO_MAGIC            0x52534157  // "WASR"
+#define WASR_PROTO_VERSION          3
+#define WASR_PROTO_MAX_PAYLOAD      (64 * 1024 * 1024)
+
+#define WASR_MSG_TRANSCRIBE         1
+#define WASR_MSG_RESULT             2
+#define WASR_MSG_ERROR              3
+#define WASR_MSG_CANCEL             4
+
+#define WASR_FLAG_FINAL             (1 << 0)
+#define WASR_FLAG_TRANSLATE         (1 << 1)
+#define WASR_FLAG_SINGLE_SEGMENT    (1 << 2)
+#define WASR_FLAG_NO_CONTEXT        (1 << 3)
+
+typedef struct {
+    uint32_t                magic;
+    uint8_t                 version;
+    uint8_t                 type;
+    uint16_t                flags;
+    uint32_t                id;
+    uint32_t                len;
+} __attribute__((packed)) wasr_msg_hdr_t;
+
+typedef struct {
+    uint32_t                samples;
+    int32_t                 audio_ctx;
+    uint32_t                max_tokens;
+    int32_t                 priority;
+    char                    lang[8];
+    uint16_t                beam_size;          // 0 = greedy
+    uint16_t                max_fallbacks;
+    float                   temperature_inc;
+    uint32_t                decode_budget_ms;
+} __attribute__((packed)) wasr_msg_transcribe_t;
+
+/* address: unix:/path/to/socket or tcp:host:port, returns a socket or -1 */
+int proto_connect(const char *address, uint32_t timeout_ms);
+int proto_listen(const char *address);
+void proto_close(int fd);
+
+void proto_hdr_init(wasr_msg_hdr_t *hdr, uint8_t type, uint16_t flags, uint32_t id, uint32_t len);
+switch_status_t proto_hdr_check(wasr_msg_hdr_t *hdr);
+
+/* gathers the pieces straight from the caller's buffers, handles short writes */
+switch_status_t proto_sendv(int fd, struct iovec *iov, int iovcnt);
+switch_status_t proto_recv(int fd, void *buf, size_t len);
+
+#endif
@@ -0,0 +1,483 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ *
+ */
+#include "mod_whisper_asr.h"
+#include <sys/socket.h>
+
+/*
+ * client side of the remote backend: a few persistent connections to whisper_asr_worker,
+ * each one carries many requests at once (one per waiting worker), a reader thread per connection
+ * hands the answers back by id.
+ */
+
+typedef struct {
+    remote_client_t         *client;
+    remote_conn_t           *conn;
+    int                     fd;
+} remote_reader_t;
+
+/* called with conn->mutex held */
+static void remote_conn_fail_pending(remote_conn_t *conn) {
+    while(conn->pending) {
+        remote_req_t *req = conn->pending;
+        conn->pending = req->next;
+        req->next = NULL;
+        req->status = SWITCH_STATUS_FALSE;
+        req->fl_done = SWITCH_TRUE;
+    }
+    conn->pending_count = 0;
+    conn->cancels_count = 0;
+    switch_thread_cond_broadcast(conn->cond);
+}
+
+/* called with conn->mutex held */
+static remote_req_t *remote_conn_unlink(remote_conn_t *conn, uint32_t id) {
+    remote_req_t **pp = &conn->pending;
+
+    while(*pp) {
+        remote_req_t *req = *pp;
+        if(req->id == id) {
+            *pp = req->next;
+            req->next = NULL;
+            conn->pending_count--;
+            return req;
+        }
+        pp = &req->next;
+    }
+
+    return NULL;
+}
+
+static void *SWITCH_THREAD_FUNC remote_reader_thread(switch_thread_t *thread, void *obj) {
+    remote_reader_t *reader = (remote_reader_t *)obj;
+    remote_client_t *client = reader->client;
+    remote_conn_t *conn = reader->conn;
+    uint8_t *payload = NULL;
+    uint32_t payload_size = 0;
+    wasr_msg_hdr_t hdr;
+
+    while(!client->fl_shutdown) {
+        remote_req_t *req = NULL;
+
+        if(proto_recv(reader->fd, &hdr, sizeof(hdr)) != SWITCH_STATUS_SUCCESS) {
+            break;
+        }
+        if(proto_hdr_check(&hdr) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Malformed message from %s\n", client->address);
+            break;
+        }
+        if(hdr.len > payload_size) {
+            switch_safe_free(payload);
+            payload_size = hdr.len;
+            switch_malloc(payload, payload_size);
+        }
+        if(hdr.len && proto_recv(reader->fd, payload, hdr.len) != SWITCH_STATUS_SUCCESS) {
+            break;
+        }
+
+        switch_mutex_lock(conn->mutex);
+        if((req = remote_conn_unlink(conn, hdr.id))) {
+            if(hdr.type == WASR_MSG_RESULT) {
+                if(hdr.len) { switch_buffer_write(req->text_buffer, payload, hdr.len); }
+                req->status = SWITCH_STATUS_SUCCESS;
+            } else {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Remote error (id=%u): %.*s\n", hdr.id, (int)hdr.len, (char *)payload);
+                req->status = SWITCH_STATUS_FALSE;
+            }
+            req->fl_done = SWITCH_TRUE;
+            switch_thread_cond_broadcast(conn->cond);
+        }
+        switch_mutex_unlock(conn->mutex);
+    }
+
+    switch_mutex_lock(conn->mutex);
+    remote_conn_fail_pending(conn);
+    if(conn->fd == reader->fd) {
+        conn->fd = -1;
+        conn->retry_ts = switch_micro_time_now() + (REMOTE_RETRY_MS * 1000);
+    }
+    conn->fl_reader = SWITCH_FALSE;
+    switch_mutex_unlock(conn->mutex);
+
+    // no sender can be in the middle of a write on it anymore
+    switch_mutex_lock(conn->send_mutex);
+    proto_close(reader->fd);
+    switch_mutex_unlock(conn->send_mutex);
+
+    if(!client->fl_shutdown) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Connection to %s lost\n", client->address);
+    }
+
+    switch_safe_free(payload);
+    switch_safe_free(reader);
+
+    __atomic_fetch_sub(&client->readers, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+/* called with conn->mutex held */
+static switch_status_t remote_conn_open(remote_client_t *client, remote_conn_t *conn) {
+    switch_threadattr_t *attr = NULL;
+    switch_thread_t *thread = NULL;
+    remote_reader_t *reader = NULL;
+    int fd = -1;
+
+    if(conn->fd >= 0) {
+        return SWITCH_STATUS_SUCCESS;
+    }
+    if(conn->fl_reader || client->fl_shutdown || switch_micro_time_now() < conn->retry_ts) {
+        return SWITCH_STATUS_FALSE;
+    }
+
+    if((fd = proto_connect(client->address, client->timeout_ms)) < 0) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to connect to %s\n", client->address);
+        conn->retry_ts = switch_micro_time_now() + (REMOTE_RETRY_MS * 1000);
+        return SWITCH_STATUS_FALSE;
+    }
+
+    switch_zmalloc(reader, sizeof(remote_reader_t));
+    reader->client = client;
+    reader->conn = conn;
+    reader->fd = fd;
+
+    conn->fd = fd;
+    conn->fl_reader = SWITCH_TRUE;
+    __atomic_fetch_add(&client->readers, 1, __ATOMIC_RELAXED);
+    metrics_add(&client->connects, 1);
+
+    switch_threadattr_create(&attr, client->pool);
+    switch_threadattr_detach_set(attr, 1);
+    switch_threadattr_stacksize_set(attr, SWITCH_THREAD_STACKSIZE);
+    if(switch_thread_create(&thread, attr, remote_reader_thread, reader, client->pool) != SWITCH_STATUS_SUCCESS) {
+        __atomic_fetch_sub(&client->readers, 1, __ATOMIC_RELAXED);
+        conn->fd = -1;
+        conn->fl_reader = SWITCH_FALSE;
+        proto_close(fd);
+        switch_safe_free(reader);
+        return SWITCH_STATUS_FALSE;
+    }
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+switch_status_t remote_client_create(remote_client_t **out, const char *address, uint32_t connections, uint32_t timeout_ms, switch_memory_pool_t *pool) {
+    remote_client_t *client = NULL;
+
+    if((client = switch_core_alloc(pool, sizeof(remote_client_t))) == NULL) {
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    client->pool = pool;
+    client->address = switch_core_strdup(pool, address);
+    client->conns_count = MAX(connections, 1);
+    client->timeout_ms = timeout_ms;
+
+    if((client->conns = switch_core_alloc(pool, client->conns_count * sizeof(remote_conn_t))) == NULL) {
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    for(uint32_t i = 0; i < client->conns_count; i++) {
+        remote_conn_t *conn = &client->conns[i];
+
+        conn->fd = -1;
+        switch_mutex_init(&conn->mutex, SWITCH_MUTEX_NESTED, pool);
+        switch_mutex_init(&conn->send_mutex, SWITCH_MUTEX_NESTED, pool);
+        switch_thread_cond_create(&conn->cond, pool);
+
+        // the worker may come up later, requests reconnect on demand
+        switch_mutex_lock(conn->mutex);
+        remote_conn_open(client, conn);
+        switch_mutex_unlock(conn->mutex);
+    }
+
+    *out = client;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void remote_client_shutdown(remote_client_t *client) {
+    client->fl_shutdown = SWITCH_TRUE;
+
+    for(uint32_t i = 0; i < client->conns_count; i++) {
+        remote_conn_t *conn = &client->conns[i];
+
+        switch_mutex_lock(conn->mutex);
+        if(conn->fd >= 0) {
+            shutdown(conn->fd, SHUT_RDWR);
+        }
+        remote_conn_fail_pending(conn);
+        switch_mutex_unlock(conn->mutex);
+    }
+
+    while(__atomic_load_n(&client->readers, __ATOMIC_RELAXED) > 0) {
+        switch_yield(10000);
+    }
+}
+
+/* the least loaded connection that is up (or may be reopened) */
+static remote_conn_t *remote_conn_pick(remote_client_t *client) {
+    remote_conn_t *best = NULL;
+    uint32_t best_pending = UINT32_MAX;
+
+    for(uint32_t i = 0; i < client->conns_count; i++) {
+        remote_conn_t *conn = &client->conns[i];
+        uint32_t pending = 0;
+        uint8_t fl_usable = SWITCH_FALSE;
+
+        switch_mutex_lock(conn->mutex);
+        pending = conn->pending_count;
+        fl_usable = (conn->fd >= 0 || (!conn->fl_reader && switch_micro_time_now() >= conn->retry_ts));
+        switch_mutex_unlock(conn->mutex);
+
+        if(fl_usable && pending < best_pending) {
+            best = conn;
+            best_pending = pending;
+        }
+    }
+
+    return best;
+}
+
+/* called with conn->mutex held. a full list drops the CANCEL, the worker's answer to it is ignored anyway */
+static void remote_conn_cancel_push(remote_conn_t *conn, uint32_t id) {
+    if(conn->fd >= 0 && conn->cancels_count < REMOTE_CANCELS_MAX) {
+        conn->cancels[conn->cancels_count++] = id;
+    }
+}
+
+/* called with send_mutex held, the CANCELs listed so far go out in one write */
+static void remote_conn_cancel_flush(remote_conn_t *conn) {
+    wasr_msg_hdr_t hdrs[REMOTE_CANCELS_MAX];
+    struct iovec iov;
+    uint32_t count = 0;
+    int fd = -1;
+
+    switch_mutex_lock(conn->mutex);
+    for(count = 0; count < conn->cancels_count; count++) {
+        proto_hdr_init(&hdrs[count], WASR_MSG_CANCEL, 0, conn->cancels[count], 0);
+    }
+    conn->cancels_count = 0;
+    fd = conn->fd;
+    switch_mutex_unlock(conn->mutex);
+
+    if(count && fd >= 0) {
+        iov.iov_base = hdrs; iov.iov_len = (count * sizeof(wasr_msg_hdr_t));
+        proto_sendv(fd, &iov, 1);
+    }
+}
+
+/* never waits behind a send in progress (megabytes of audio), its sender flushes the list when it is done */
+static void remote_conn_cancel_kick(remote_conn_t *conn) {
+    if(switch_mutex_trylock(conn->send_mutex) == SWITCH_STATUS_SUCCESS) {
+        remote_conn_cancel_flush(conn);
+        switch_mutex_unlock(conn->send_mutex);
+    }
+}
+
+/* the reader closes a dead socket only under send_mutex, after it has cleared conn->fd */
+static switch_status_t remote_conn_send(remote_conn_t *conn, int fd, struct iovec *iov, int iovcnt) {
+    switch_status_t status = SWITCH_STATUS_FALSE;
+
+    switch_mutex_lock(conn->send_mutex);
+    switch_mutex_lock(conn->mutex);
+    status = (conn->fd == fd ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE);
+    switch_mutex_unlock(conn->mutex);
+    if(status == SWITCH_STATUS_SUCCESS) {
+        status = proto_sendv(fd, iov, iovcnt);
+    }
+    remote_conn_cancel_flush(conn);
+    switch_mutex_unlock(conn->send_mutex);
+
+    // listed after the flush above, while the lock was still taken
+    if(__atomic_load_n(&conn->cancels_count, __ATOMIC_RELAXED)) {
+        remote_conn_cancel_kick(conn);
+    }
+
+    return status;
+}
+
+switch_status_t remote_transcribe(remote_client_t *client, wasr_job_t *job, globals_t *globals) {
+    switch_status_t status = SWITCH_STATUS_FALSE;
+    switch_time_t started = switch_micro_time_now();
+    switch_time_t deadline = started + ((switch_time_t)client->timeout_ms * 1000);
+    remote_req_t req = { .job = job, .text_buffer = job->text_buffer, .status = SWITCH_STATUS_FALSE };
+    wasr_ctx_t *asr_ctx = job->asr_ctx;
+    wasr_msg_transcribe_t body = { 0 };
+    wasr_msg_hdr_t hdr;
+    struct iovec iov[3];
+    remote_conn_t *conn = NULL;
+    uint16_t flags = 0;
+    uint8_t fl_timeout = SWITCH_FALSE;
+    int fd = -1;
+
+    metrics_add(&client->requests, 1);
+
+    if((conn = remote_conn_pick(client)) == NULL) {
+        goto fail;
+    }
+
+    body.samples = job->samples;
+    body.audio_ctx = asr_ctx->audio_ctx;
+    body.max_tokens = asr_ctx->whisper_max_tokens;
+    body.priority = asr_ctx->priority;
+    body.beam_size = asr_ctx->whisper_beam_size;
+    body.max_fallbacks = asr_ctx->whisper_max_fallbacks;
+    body.temperature_inc = asr_ctx->whisper_temperature_inc;
+    body.decode_budget_ms = asr_ctx->decode_budget_ms;
+    if(asr_ctx->lang) {
+        strncpy(body.lang, asr_ctx->lang, sizeof(body.lang) - 1);
+    }
+
+    flags |= (job->fl_final ? WASR_FLAG_FINAL : 0);
+    flags |= (asr_ctx->whisper_translate ? WASR_FLAG_TRANSLATE : 0);
+    flags |= (asr_ctx->whisper_single_segment ? WASR_FLAG_SINGLE_SEGMENT : 0);
+    flags |= (asr_ctx->whisper_no_context ? WASR_FLAG_NO_CONTEXT : 0);
+
+    req.id = __atomic_add_fetch(&client->next_id, 1, __ATOMIC_RELAXED);
+    proto_hdr_init(&hdr, WASR_MSG_TRANSCRIBE, flags, req.id, (sizeof(body) + job->samples * sizeof(float)));
+
+    switch_mutex_lock(conn->mutex);
+    if(remote_conn_open(client, conn) != SWITCH_STATUS_SUCCESS) {
+        switch_mutex_unlock(conn->mutex);
+        goto fail;
+    }
+    fd = conn->fd;
+    req.next = conn->pending;
+    conn->pending = &req;
+    conn->pending_count++;
+    // remote_client_cancel() either finds the request listed or the job already marked
+    if(job_cancelled(job)) {
+        remote_conn_unlink(conn, req.id);
+        switch_mutex_unlock(conn->mutex);
+        return SWITCH_STATUS_BREAK;
+    }
+    switch_mutex_unlock(conn->mutex);
+
+    // the audio goes out of the job buffer as is
+    iov[0].iov_base = &hdr;         iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = &body;        iov[1].iov_len = sizeof(body);
+    iov[2].iov_base = job->audio;   iov[2].iov_len = (job->samples * sizeof(float));
+
+    status = remote_conn_send(conn, fd, iov, 3);
+
+    switch_mutex_lock(conn->mutex);
+    if(status != SWITCH_STATUS_SUCCESS) {
+        // the reader sees the broken socket and fails the others
+        if(!remote_conn_unlink(conn, req.id) && req.fl_done) {
+            status = req.status;
+        }
+        if(conn->fd == fd) { shutdown(fd, SHUT_RDWR); }
+    } else {
+        while(!req.fl_done) {
+            switch_time_t now = switch_micro_time_now();
+            if(now >= deadline) {
+                switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Remote request timed out (id=%u)\n", req.id);
+                // the worker would go on with an inference nobody waits for
+                if(remote_conn_unlink(conn, req.id)) {
+                    remote_conn_cancel_push(conn, req.id);
+                    fl_timeout = SWITCH_TRUE;
+                }
+                break;
+            }
+            switch_thread_cond_timedwait(conn->cond, conn->mutex, (deadline - now));
+        }
+        status = (req.fl_done ? req.status : SWITCH_STATUS_TIMEOUT);
+    }
+    switch_mutex_unlock(conn->mutex);
+
+    if(fl_timeout) {
+        remote_conn_cancel_kick(conn);
+    }
+
+    if(status == SWITCH_STATUS_SUCCESS) {
+        switch_time_t now = switch_micro_time_now();
+        metrics_hist_add(&globals->metrics.stages[METRICS_STAGE_INFERENCE], (now - started));
+        metrics_add(&globals->metrics.inference_us, (now - started));
+        job->inference_us = (now - started);
+        metrics_add(&globals->metrics.audio_us, ((uint64_t)job->samples * 1000000 / WHISPER_SAMPLE_RATE));
+        return status;
+    }
+    if(status == SWITCH_STATUS_BREAK) {
+        return status;
+    }
+fail:
+    metrics_add(&client->errors, 1);
+    return SWITCH_STATUS_FALSE;
+}
+
+/*
+ * wakes up the worker waiting on the session's request and asks whisper_asr_worker to stop on it.
+ * the CANCEL is only listed when another sender has the socket, so this never blocks on the network
+ */
+void remote_client_cancel(remote_client_t *client, wasr_ctx_t *asr_ctx) {
+    for(uint32_t i = 0; i < client->conns_count; i++) {
+        remote_conn_t *conn = &client->conns[i];
+        remote_req_t **pp = NULL;
+        uint8_t fl_cancelled = SWITCH_FALSE;
+
+        switch_mutex_lock(conn->mutex);
+        for(pp = &conn->pending; *pp; ) {
+            remote_req_t *req = *pp;
+            if(req->job->asr_ctx != asr_ctx) {
+                pp = &req->next;
+                continue;
+            }
+            *pp = req->next;
+            req->next = NULL;
+            conn->pending_count--;
+            remote_conn_cancel_push(conn, req->id);
+            req->status = SWITCH_STATUS_BREAK;
+            req->fl_done = SWITCH_TRUE;
+            fl_cancelled = SWITCH_TRUE;
+        }
+        if(fl_cancelled) {
+            switch_thread_cond_broadcast(conn->cond);
+        }
+        switch_mutex_unlock(conn->mutex);
+
+        if(fl_cancelled) {
+            remote_conn_cancel_kick(conn);
+        }
+    }
+}
+
+uint32_t remote_client_connected(remote_client_t *client) {
+    uint32_t count = 0;
+
+    for(uint32_t i = 0; i < client->conns_count; i++) {
+        switch_mutex_lock(client->conns[i].mutex);
+        count += (client->conns[i].fd >= 0);
+        switch_mutex_unlock(client->conns[i].mutex);
+    }
+
+    return count;
+}
+
+uint32_t remote_client_in_flight(remote_client_t *client) {
+    uint32_t count = 0;
+
+    for(uint32_t i = 0; i < client->conns_count; i++) {
+        switch_mutex_lock(client->conns[i].mutex);
+        count += client->conns[i].pending_count;
+        switch_mutex_unlock(client->conns[i].mutex);
+    }
+
+    return count;
+}
@@ -19,7 +19,52 @@
  *
  *
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "mod_whisper_asr.h"
+#include <math.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+uint32_t asr_ctx_take(wasr_ctx_t *asr_ctx) {
+    uint32_t refs = 0;
+
+    switch_mutex_lock(asr_ctx->mutex);
+    if(!asr_ctx->fl_destroyed) {
+        refs = ++asr_ctx->refs;
+    }
+    switch_mutex_unlock(asr_ctx->mutex);
+
+    return refs;
+}
+
+void asr_ctx_release(wasr_ctx_t *asr_ctx) {
+    switch_mutex_lock(asr_ctx->mutex);
+    if(asr_ctx->refs > 0) asr_ctx->refs--;
+    if(!asr_ctx->refs && asr_ctx->fl_destroyed && asr_ctx->cond) {
+        switch_thread_cond_signal(asr_ctx->cond);
+    }
+    switch_mutex_unlock(asr_ctx->mutex);
+}
+
+/* the session has gone or dropped its audio (pause-discard) since the job was taken */
+uint8_t job_cancelled(wasr_job_t *job) {
+    wasr_ctx_t *asr_ctx = job->asr_ctx;
+
+    return (asr_ctx->fl_abort || job->cancel_gen != __atomic_load_n(&asr_ctx->cancel_gen, __ATOMIC_ACQUIRE));
+}
 
 switch_status_t xdata_buffer_alloc(xdata_buffer_t **out, switch_byte_t *data, uint32_t data_len) {
     xdata_buffer_t *buf = NULL;
@@ -69,62 +114,1580 @@ switch_status_t xdata_buffer_push(switch_queue_t *queue, switch_byte_t *data, ui
     return SWITCH_STATUS_FALSE;
 }
 
-static bool xxx_whisper_encoder_begin_callback(struct whisper_context *ctx, struct whisper_state *state, void *udata) {
-    wasr_ctx_t *asr_ctx = (wasr_ctx_t *)udata;
-    return(asr_ctx->fl_abort ? false : true);
+/* the ring size is a power of two >= samples */
+uint32_t audio_ring_size(uint32_t samples) {
+    uint32_t size = 1;
+
+    while(size < samples) { size <<= 1; }
+
+    return size;
 }
 
-switch_status_t transcribe(wasr_ctx_t *ast_ctx, float *audio, uint32_t samples, switch_buffer_t *text_buffer, globals_t *globals) {
-    switch_status_t status = SWITCH_STATUS_SUCCESS;
-    struct whisper_full_params wparams = {0};
-    int segments = 0;
+/* data holds audio_ring_size(samples) samples and is owned by the caller */
+switch_status_t audio_ring_init(audio_ring_t *ring, int16_t *data, uint32_t samples) {
+    uint32_t size = audio_ring_size(samples);
+
+    if(!data) {
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    ring->data = data;
+    ring->size = size;
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->overflows = 0;
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* producer side, returns the number of written samples, the rest is counted as overflow */
+uint32_t audio_ring_write(audio_ring_t *ring, const int16_t *data, uint32_t samples) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t space = ring->size - (head - tail);
+    uint32_t len = MIN(samples, space);
+    uint32_t ofs = (head & ring->mask);
+    uint32_t l1 = MIN(len, ring->size - ofs);
+
+    if(len) {
+        memcpy(ring->data + ofs, data, l1 * sizeof(int16_t));
+        if(len > l1) {
+            memcpy(ring->data, data + l1, (len - l1) * sizeof(int16_t));
+        }
+        __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+    }
+    if(len < samples) {
+        __atomic_fetch_add(&ring->overflows, (samples - len), __ATOMIC_RELAXED);
+    }
+
+    return len;
+}
+
+/* single thread history: keeps the newest samples, the oldest ones are overwritten */
+void audio_ring_write_over(audio_ring_t *ring, const int16_t *data, uint32_t samples) {
+    uint32_t used = (ring->head - ring->tail);
+
+    if(samples > ring->size) {
+        data += (samples - ring->size);
+        samples = ring->size;
+    }
+    if(used + samples > ring->size) {
+        ring->tail += (used + samples - ring->size);
+    }
+
+    audio_ring_write(ring, data, samples);
+}
+
+uint32_t audio_ring_used(audio_ring_t *ring) {
+    return (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+}
+
+/* consumer side, up to two contiguous spans without copying */
+uint32_t audio_ring_peek(audio_ring_t *ring, uint32_t samples, int16_t **p1, uint32_t *l1, int16_t **p2, uint32_t *l2) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t len = MIN(samples, (head - tail));
+    uint32_t ofs = (tail & ring->mask);
+
+    *p1 = ring->data + ofs;
+    *l1 = MIN(len, ring->size - ofs);
+    *p2 = ring->data;
+    *l2 = len - *l1;
+
+    return len;
+}
+
+void audio_ring_consume(audio_ring_t *ring, uint32_t samples) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->tail, tail + samples, __ATOMIC_RELEASE);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// jobs queue: binary min-heap under a mutex, same semantics as switch_queue (trypush/pop_timeout/interrupt)
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+static inline int jobs_queue_less(jobs_queue_entry_t *a, jobs_queue_entry_t *b) {
+    return (a->key < b->key || (a->key == b->key && a->seq < b->seq));
+}
+
+switch_status_t jobs_queue_create(jobs_queue_t **queue, uint32_t capacity, switch_memory_pool_t *pool) {
+    jobs_queue_t *q = NULL;
+
+    if((q = switch_core_alloc(pool, sizeof(jobs_queue_t))) == NULL) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    if((q->heap = switch_core_alloc(pool, capacity * sizeof(jobs_queue_entry_t))) == NULL) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    if(switch_mutex_init(&q->mutex, SWITCH_MUTEX_NESTED, pool) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_GENERR;
+    }
+    if(switch_thread_cond_create(&q->cond, pool) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_GENERR;
+    }
+
+    q->capacity = capacity;
+    *queue = q;
+
+    return SWITCH_STATUS_SUCCESS;
+}
 
-    if(!ast_ctx->wctx) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "(ast_ctx->wctx == NULL)\n");
+/* puts 'e' into the free slot 'i' and moves it up/down until the heap order holds again */
+static void jobs_queue_sift_up(jobs_queue_t *queue, uint32_t i, jobs_queue_entry_t e) {
+    while(i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if(!jobs_queue_less(&e, &queue->heap[parent])) { break; }
+        queue->heap[i] = queue->heap[parent];
+        i = parent;
+    }
+    queue->heap[i] = e;
+}
+
+static void jobs_queue_sift_down(jobs_queue_t *queue, uint32_t i, jobs_queue_entry_t e) {
+    while(SWITCH_TRUE) {
+        uint32_t child = (i * 2) + 1;
+        if(child >= queue->size) { break; }
+        if(child + 1 < queue->size && jobs_queue_less(&queue->heap[child + 1], &queue->heap[child])) { child++; }
+        if(!jobs_queue_less(&queue->heap[child], &e)) { break; }
+        queue->heap[i] = queue->heap[child];
+        i = child;
+    }
+    queue->heap[i] = e;
+}
+
+/* never blocks, fails when the queue is full */
+switch_status_t jobs_queue_push(jobs_queue_t *queue, void *data, int64_t key) {
+    jobs_queue_entry_t e = { .data = data, .key = key };
+
+    switch_mutex_lock(queue->mutex);
+    if(queue->size >= queue->capacity) {
+        switch_mutex_unlock(queue->mutex);
         return SWITCH_STATUS_FALSE;
     }
 
-    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "transcribe samples=%d\n", samples);
+    e.seq = queue->seq++;
+    jobs_queue_sift_up(queue, queue->size++, e);
 
-    wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
-    wparams.print_progress   = false;
-    wparams.print_special    = false;
-    wparams.print_realtime   = false;
-    wparams.print_timestamps = false;
-    wparams.translate        = ast_ctx->whisper_translate;
-    wparams.single_segment   = ast_ctx->whisper_single_segment;
-    wparams.max_tokens       = ast_ctx->whisper_max_tokens;
-    wparams.language         = ast_ctx->lang ? ast_ctx->lang : "en";
-    wparams.n_threads        = globals->whisper_threads;
-    wparams.audio_ctx        = 0;
+    switch_thread_cond_signal(queue->cond);
+    switch_mutex_unlock(queue->mutex);
+
+    return SWITCH_STATUS_SUCCESS;
+}
 
-    wparams.encoder_begin_callback_user_data = ast_ctx;
-    wparams.encoder_begin_callback = (whisper_encoder_begin_callback) xxx_whisper_encoder_begin_callback;
+/* must be called with queue->mutex locked and size > 0 */
+static void *jobs_queue_take(jobs_queue_t *queue) {
+    void *data = queue->heap[0].data;
+    jobs_queue_entry_t last = queue->heap[--queue->size];
 
-    if(whisper_full(ast_ctx->wctx, wparams, audio, samples) != 0) {
-        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "whisper_full()\n");
-        switch_goto_status(SWITCH_STATUS_FALSE, out);
+    if(queue->size) {
+        jobs_queue_sift_down(queue, 0, last);
     }
 
-    if(ast_ctx->fl_abort) {
-        goto out;
+    return data;
+}
+
+/* takes a cancelled entry out wherever it is, fails if a worker has already popped it */
+switch_status_t jobs_queue_remove(jobs_queue_t *queue, void *data) {
+    switch_status_t status = SWITCH_STATUS_NOTFOUND;
+    uint32_t i = 0;
+
+    switch_mutex_lock(queue->mutex);
+    for(i = 0; i < queue->size; i++) {
+        if(queue->heap[i].data == data) { break; }
     }
+    if(i < queue->size) {
+        jobs_queue_entry_t last = queue->heap[--queue->size];
 
-    if((segments = whisper_full_n_segments(ast_ctx->wctx))) {
-        for(uint32_t i = 0; i < segments; ++i) {
-            const char *text = whisper_full_get_segment_text(ast_ctx->wctx, i);
-            if(text) {
-                switch_buffer_write(text_buffer, text, strlen(text));
-                switch_buffer_write(text_buffer, "\n", 1);
+        if(i < queue->size) {
+            if(i > 0 && jobs_queue_less(&last, &queue->heap[(i - 1) / 2])) {
+                jobs_queue_sift_up(queue, i, last);
+            } else {
+                jobs_queue_sift_down(queue, i, last);
             }
         }
+        status = SWITCH_STATUS_SUCCESS;
     }
-out:
+    switch_mutex_unlock(queue->mutex);
+
+    return status;
+}
+
+switch_status_t jobs_queue_pop_timeout(jobs_queue_t *queue, void **data, switch_interval_time_t timeout) {
+    switch_status_t status = SWITCH_STATUS_TIMEOUT;
+    switch_time_t deadline = switch_micro_time_now() + timeout;
+
+    switch_mutex_lock(queue->mutex);
+    while(!queue->size && !queue->fl_interrupted) {
+        switch_time_t now = switch_micro_time_now();
+        if(now >= deadline) { break; }
+        switch_thread_cond_timedwait(queue->cond, queue->mutex, (deadline - now));
+    }
+    if(queue->fl_interrupted) {
+        status = SWITCH_STATUS_BREAK;
+    } else if(queue->size) {
+        *data = jobs_queue_take(queue);
+        status = SWITCH_STATUS_SUCCESS;
+    }
+    switch_mutex_unlock(queue->mutex);
+
+    return status;
+}
+
+switch_status_t jobs_queue_trypop(jobs_queue_t *queue, void **data) {
+    switch_status_t status = SWITCH_STATUS_FALSE;
+
+    switch_mutex_lock(queue->mutex);
+    if(queue->size) {
+        *data = jobs_queue_take(queue);
+        status = SWITCH_STATUS_SUCCESS;
+    }
+    switch_mutex_unlock(queue->mutex);
+
     return status;
 }
 
-void i2f(int16_t *in, float *out, uint32_t samples) {
-    for(uint32_t i = 0; i < samples; i++) {
-        out[i] = (float) ((in[i] > 0) ? (in[i] / 32767.0) : (in[i] / 32768.0));
+uint32_t jobs_queue_size(jobs_queue_t *queue) {
+    uint32_t size = 0;
+
+    switch_mutex_lock(queue->mutex);
+    size = queue->size;
+    switch_mutex_unlock(queue->mutex);
+
+    return size;
+}
+
+void jobs_queue_interrupt_all(jobs_queue_t *queue) {
+    switch_mutex_lock(queue->mutex);
+    queue->fl_interrupted = SWITCH_TRUE;
+    switch_thread_cond_broadcast(queue->cond);
+    switch_mutex_unlock(queue->mutex);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// buffers arena
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+/* sits in front of every block, 'next' links the idle blocks of a class */
+typedef struct {
+    void                    *next;
+    switch_size_t           size;
+} buf_arena_hdr_t;
+
+#define BUF_ARENA_HDR_SIZE  16
+
+static inline int32_t buf_arena_class(switch_size_t size) {
+    uint32_t shift = BUF_ARENA_MIN_SHIFT;
+
+    while(((switch_size_t)1 << shift) < size) { shift++; }
+
+    return (shift - BUF_ARENA_MIN_SHIFT < BUF_ARENA_CLASSES ? (int32_t)(shift - BUF_ARENA_MIN_SHIFT) : -1);
+}
+
+switch_status_t buf_arena_create(buf_arena_t **out, switch_size_t max_idle, switch_memory_pool_t *pool) {
+    buf_arena_t *arena = NULL;
+
+    if((arena = switch_core_alloc(pool, sizeof(buf_arena_t))) == NULL) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    if(switch_mutex_init(&arena->mutex, SWITCH_MUTEX_NESTED, pool) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_GENERR;
+    }
+
+    arena->max_idle = max_idle;
+    *out = arena;
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+void buf_arena_destroy(buf_arena_t *arena) {
+    switch_mutex_lock(arena->mutex);
+    for(uint32_t i = 0; i < BUF_ARENA_CLASSES; i++) {
+        while(arena->free[i]) {
+            buf_arena_hdr_t *hdr = (buf_arena_hdr_t *)arena->free[i];
+            arena->free[i] = hdr->next;
+            free(hdr);
+        }
+        arena->free_count[i] = 0;
+    }
+    arena->idle_bytes = 0;
+    arena->max_idle = 0;
+    switch_mutex_unlock(arena->mutex);
+}
+
+/* rounds up to the size class, the block can be used up to buf_arena_block_size() */
+void *buf_arena_alloc(buf_arena_t *arena, switch_size_t size) {
+    int32_t cls = buf_arena_class(size);
+    switch_size_t bsize = (cls >= 0 ? ((switch_size_t)1 << (cls + BUF_ARENA_MIN_SHIFT)) : size);
+    buf_arena_hdr_t *hdr = NULL;
+
+    switch_mutex_lock(arena->mutex);
+    if(cls >= 0 && arena->free[cls]) {
+        hdr = (buf_arena_hdr_t *)arena->free[cls];
+        arena->free[cls] = hdr->next;
+        arena->free_count[cls]--;
+        arena->idle_bytes -= bsize;
+        arena->reuses++;
+    }
+    arena->allocs++;
+    arena->used_bytes += bsize;
+    arena->used_peak = MAX(arena->used_peak, arena->used_bytes);
+    switch_mutex_unlock(arena->mutex);
+
+    if(!hdr) {
+        switch_malloc(hdr, BUF_ARENA_HDR_SIZE + bsize);
+    }
+
+    hdr->next = NULL;
+    hdr->size = bsize;
+
+    return ((uint8_t *)hdr + BUF_ARENA_HDR_SIZE);
+}
+
+void buf_arena_free(buf_arena_t *arena, void *ptr) {
+    buf_arena_hdr_t *hdr = NULL;
+    int32_t cls = 0;
+
+    if(!ptr) {
+        return;
+    }
+
+    hdr = (buf_arena_hdr_t *)((uint8_t *)ptr - BUF_ARENA_HDR_SIZE);
+    cls = buf_arena_class(hdr->size);
+
+    switch_mutex_lock(arena->mutex);
+    arena->used_bytes -= hdr->size;
+    if(cls >= 0 && arena->idle_bytes + hdr->size <= arena->max_idle) {
+        hdr->next = arena->free[cls];
+        arena->free[cls] = hdr;
+        arena->free_count[cls]++;
+        arena->idle_bytes += hdr->size;
+        hdr = NULL;
+    }
+    switch_mutex_unlock(arena->mutex);
+
+    if(hdr) {
+        free(hdr);
+    }
+}
+
+switch_size_t buf_arena_block_size(void *ptr) {
+    return ((buf_arena_hdr_t *)((uint8_t *)ptr - BUF_ARENA_HDR_SIZE))->size;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// session resources pool
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+static void sess_res_destroy(sess_res_t **res) {
+    sess_res_t *r = *res;
+
+    if(!r) {
+        return;
+    }
+    if(r->vad) {
+        switch_vad_destroy(&r->vad);
+    }
+    if(r->resampler) {
+        speex_resampler_destroy(r->resampler);
+    }
+    if(r->wstate) {
+        whisper_free_state(r->wstate);
+    }
+    model_set_release(r->mset);
+
+    switch_safe_free(r);
+    *res = NULL;
+}
+
+/* vad and resampler depend on the call rate, the whisper state does not */
+static switch_status_t sess_res_set_rate(sess_res_t *res, uint32_t samplerate, globals_t *globals) {
+    int err = 0;
+
+    if(res->vad && res->samplerate == samplerate) {
+        return SWITCH_STATUS_SUCCESS;
+    }
+
+    if(res->vad) {
+        switch_vad_destroy(&res->vad);
+    }
+    if(res->resampler) {
+        speex_resampler_destroy(res->resampler);
+        res->resampler = NULL;
+    }
+    res->samplerate = 0;
+
+    if((res->vad = switch_vad_init(samplerate, 1)) == NULL) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't init VAD\n");
+        return SWITCH_STATUS_GENERR;
+    }
+
+    switch_vad_set_mode(res->vad, -1);
+    switch_vad_set_param(res->vad, "debug", globals->fl_vad_debug);
+    if(globals->vad_silence_ms > 0)  { switch_vad_set_param(res->vad, "silence_ms", globals->vad_silence_ms); }
+    if(globals->vad_voice_ms > 0)    { switch_vad_set_param(res->vad, "voice_ms", globals->vad_voice_ms); }
+    if(globals->vad_threshold > 0)   { switch_vad_set_param(res->vad, "thresh", globals->vad_threshold); }
+
+    if(samplerate != WHISPER_SAMPLE_RATE) {
+        res->resampler = speex_resampler_init(1, samplerate, WHISPER_SAMPLE_RATE, SWITCH_RESAMPLE_QUALITY, &err);
+        if(err != 0 || !res->resampler) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "speex_resampler_init() : %s\n", speex_resampler_strerror(err));
+            return SWITCH_STATUS_GENERR;
+        }
+    }
+
+    res->samplerate = samplerate;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+static sess_res_t *sess_res_create(uint32_t samplerate, globals_t *globals) {
+    sess_res_t *res = NULL;
+
+    switch_zmalloc(res, sizeof(sess_res_t));
+
+    // no model in the remote mode, only vad and resampler are kept
+    res->mset = model_set_acquire(globals);
+    if(res->mset && res->mset->models[0].wctx && (res->wstate = whisper_init_state(res->mset->models[0].wctx)) == NULL) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "whisper_init_state()\n");
+        goto fail;
+    }
+    if(sess_res_set_rate(res, samplerate, globals) != SWITCH_STATUS_SUCCESS) {
+        goto fail;
+    }
+
+    return res;
+fail:
+    sess_res_destroy(&res);
+    return NULL;
+}
+
+/* rates: comma separated list of the call rates the idle resources are prepared for */
+switch_status_t sess_pool_create(sess_pool_t **out, uint32_t min, uint32_t max, const char *rates, switch_memory_pool_t *pool) {
+    sess_pool_t *sp = NULL;
+    char *rates_dup = NULL, *argv[POOL_RATES_MAX] = { 0 };
+    uint32_t argc = 0;
+
+    if((sp = switch_core_alloc(pool, sizeof(sess_pool_t))) == NULL) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    if(switch_mutex_init(&sp->mutex, SWITCH_MUTEX_NESTED, pool) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_GENERR;
+    }
+
+    sp->max = MAX(max, 1);
+    sp->min = MIN(min, sp->max);
+
+    if((sp->items = switch_core_alloc(pool, sp->max * sizeof(sess_res_t *))) == NULL) {
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    if(!zstr(rates) && (rates_dup = switch_core_strdup(pool, rates))) {
+        argc = switch_separate_string(rates_dup, ',', argv, POOL_RATES_MAX);
+        for(uint32_t i = 0; i < argc; i++) {
+            uint32_t rate = atoi(argv[i]);
+            if(rate > 0) { sp->rates[sp->rates_count++] = rate; }
+        }
+    }
+    if(!sp->rates_count) {
+        sp->rates[sp->rates_count++] = WHISPER_SAMPLE_RATE;
+    }
+
+    *out = sp;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* items in use are freed by sess_pool_release() */
+void sess_pool_destroy(sess_pool_t *sess_pool) {
+    switch_mutex_lock(sess_pool->mutex);
+    while(sess_pool->size > 0) {
+        sess_res_destroy(&sess_pool->items[--sess_pool->size]);
+        sess_pool->created--;
+    }
+    sess_pool->max = 0;
+    switch_mutex_unlock(sess_pool->mutex);
+}
+
+/* drops the idle items made for an older model set than gen, sess_pool_fill() makes the new ones */
+void sess_pool_flush(sess_pool_t *sess_pool, uint32_t gen) {
+    switch_mutex_lock(sess_pool->mutex);
+    sess_pool->gen = gen;
+    for(uint32_t i = 0; i < sess_pool->size; ) {
+        sess_res_t *res = sess_pool->items[i];
+        if(res->mset && res->mset->gen == gen) {
+            i++;
+            continue;
+        }
+        sess_pool->items[i] = sess_pool->items[--sess_pool->size];
+        sess_pool->created--;
+        sess_res_destroy(&res);
+    }
+    switch_mutex_unlock(sess_pool->mutex);
+}
+
+/* moves a session state made for an older model set to the current one, by the worker that holds the session */
+switch_status_t sess_res_rebind(sess_res_t *res, globals_t *globals) {
+    wasr_model_set_t *mset = model_set_acquire(globals);
+    struct whisper_state *wstate = NULL;
+
+    if(!mset || mset == res->mset) {
+        model_set_release(mset);
+        return SWITCH_STATUS_SUCCESS;
+    }
+    if(mset->models[0].wctx && (wstate = whisper_init_state(mset->models[0].wctx)) == NULL) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "whisper_init_state()\n");
+        model_set_release(mset);
+        return SWITCH_STATUS_GENERR;
+    }
+
+    if(res->wstate) {
+        whisper_free_state(res->wstate);
+    }
+    model_set_release(res->mset);
+    res->wstate = wstate;
+    res->mset = mset;
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* tops the idle items up to min, the slow part runs outside of the lock */
+void sess_pool_fill(sess_pool_t *sess_pool, globals_t *globals) {
+    sess_res_t *res = NULL;
+    uint32_t rate = 0;
+
+    while(!globals->fl_shutdown) {
+        switch_mutex_lock(sess_pool->mutex);
+        if(sess_pool->size >= sess_pool->min || sess_pool->created >= sess_pool->max) {
+            switch_mutex_unlock(sess_pool->mutex);
+            break;
+        }
+        rate = sess_pool->rates[sess_pool->rates_next++ % sess_pool->rates_count];
+        sess_pool->created++;
+        switch_mutex_unlock(sess_pool->mutex);
+
+        res = sess_res_create(rate, globals);
+
+        switch_mutex_lock(sess_pool->mutex);
+        if(res && res->mset && res->mset->gen == sess_pool->gen && sess_pool->size < sess_pool->max) {
+            sess_pool->items[sess_pool->size++] = res;
+            res = NULL;
+        } else {
+            sess_pool->created--;
+        }
+        switch_mutex_unlock(sess_pool->mutex);
+
+        if(res) {
+            sess_res_destroy(&res);
+            break;
+        }
+    }
+}
+
+/* prefers an idle item prepared for the same rate, creates a new one when the pool is empty */
+sess_res_t *sess_pool_acquire(sess_pool_t *sess_pool, uint32_t samplerate, globals_t *globals) {
+    sess_res_t *res = NULL;
+
+    switch_mutex_lock(sess_pool->mutex);
+    if(sess_pool->size > 0) {
+        uint32_t idx = sess_pool->size - 1;
+        for(uint32_t i = 0; i < sess_pool->size; i++) {
+            if(sess_pool->items[i]->samplerate == samplerate) { idx = i; break; }
+        }
+        res = sess_pool->items[idx];
+        sess_pool->items[idx] = sess_pool->items[--sess_pool->size];
+        sess_pool->hits++;
+    } else {
+        sess_pool->created++;
+        sess_pool->misses++;
+    }
+    switch_mutex_unlock(sess_pool->mutex);
+
+    if(!res) {
+        if((res = sess_res_create(samplerate, globals)) == NULL) {
+            switch_mutex_lock(sess_pool->mutex);
+            sess_pool->created--;
+            switch_mutex_unlock(sess_pool->mutex);
+        }
+        return res;
+    }
+
+    if(sess_res_set_rate(res, samplerate, globals) != SWITCH_STATUS_SUCCESS) {
+        sess_pool_release(sess_pool, res);
+        return NULL;
+    }
+
+    return res;
+}
+
+/* resets the per call state and keeps the item while the pool has room */
+void sess_pool_release(sess_pool_t *sess_pool, sess_res_t *res) {
+    if(!res) {
+        return;
+    }
+
+    if(res->vad) {
+        switch_vad_reset(res->vad);
+    }
+    if(res->resampler) {
+        speex_resampler_reset_mem(res->resampler);
+    }
+
+    switch_mutex_lock(sess_pool->mutex);
+    if(res->vad && res->mset && res->mset->gen == sess_pool->gen && sess_pool->size < sess_pool->max) {
+        sess_pool->items[sess_pool->size++] = res;
+        res = NULL;
+    } else {
+        sess_pool->created--;
+    }
+    switch_mutex_unlock(sess_pool->mutex);
+
+    if(res) {
+        sess_res_destroy(&res);
+    }
+}
+
+static struct whisper_full_params warmup_params(globals_t *globals) {
+    struct whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+
+    wparams.print_progress   = false;
+    wparams.print_special    = false;
+    wparams.print_realtime   = false;
+    wparams.print_timestamps = false;
+    wparams.single_segment   = true;
+    wparams.no_context       = true;
+    wparams.max_tokens       = 1;
+    wparams.language         = "en";
+    wparams.n_threads        = (globals->cpu_budget ? globals->cpu_max_threads : globals->whisper_n_threads);
+    wparams.audio_ctx        = globals->audio_ctx_min;
+
+    return wparams;
+}
+
+/* one short inference per idle state, so the first call doesn't pay for the lazy allocations and page-ins */
+void sess_pool_warmup(sess_pool_t *sess_pool, globals_t *globals) {
+    const uint32_t samples = (WHISPER_SAMPLE_RATE * WARMUP_AUDIO_MS) / 1000;
+    struct whisper_full_params wparams = warmup_params(globals);
+    switch_time_t started = switch_micro_time_now();
+    float *audio = NULL;
+
+    switch_zmalloc(audio, samples * sizeof(float));
+
+    switch_mutex_lock(sess_pool->mutex);
+    for(uint32_t i = 0; i < sess_pool->size; i++) {
+        sess_res_t *res = sess_pool->items[i];
+        if(!res->wstate) {
+            continue;
+        }
+        if(whisper_full_with_state(res->mset->models[0].wctx, res->wstate, wparams, audio, samples) != 0) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Warm-up inference failed\n");
+            break;
+        }
+    }
+    switch_mutex_unlock(sess_pool->mutex);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Warm-up: %u states in %"SWITCH_INT64_T_FMT" ms\n",
+        sess_pool->size, (int64_t)((switch_micro_time_now() - started) / 1000));
+
+    switch_safe_free(audio);
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// model loading
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+#ifdef __linux__
+typedef struct {
+    const uint8_t           *data;
+    size_t                  size;
+    size_t                  pos;
+} model_map_t;
+
+static size_t model_map_read(void *ctx, void *output, size_t read_size) {
+    model_map_t *map = (model_map_t *)ctx;
+    size_t len = MIN(read_size, map->size - map->pos);
+
+    memcpy(output, map->data + map->pos, len);
+    map->pos += len;
+
+    return len;
+}
+
+static bool model_map_eof(void *ctx) {
+    model_map_t *map = (model_map_t *)ctx;
+    return (map->pos >= map->size);
+}
+
+static void model_map_close(void *ctx) {
+    // unmapped by model_load_mmap()
+}
+
+/*
+ * whisper copies the tensors out of a read-only mapping of the file: no read() syscalls and bounce buffer,
+ * the kernel reads ahead the whole file (populate) and its pages stay in the page cache shared by all processes,
+ * so another instance or a reload of the same file loads from memory. it saves i/o only: the copy is private
+ * to each process and the mapping is gone after the load.
+ */
+static struct whisper_context *model_load_mmap(const char *file, struct whisper_context_params cparams, uint8_t fl_populate, uint64_t *file_size) {
+    struct whisper_context *wctx = NULL;
+    whisper_model_loader loader = { 0 };
+    model_map_t map = { 0 };
+    struct stat st = { 0 };
+    void *data = MAP_FAILED;
+    int fd = -1;
+
+    if((fd = open(file, O_RDONLY)) < 0 || fstat(fd, &st) != 0 || st.st_size <= 0) {
+        goto out;
+    }
+    if((data = mmap(NULL, st.st_size, PROT_READ, (MAP_SHARED | (fl_populate ? MAP_POPULATE : 0)), fd, 0)) == MAP_FAILED) {
+        goto out;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    map.data = data;
+    map.size = st.st_size;
+    loader.context = &map;
+    loader.read = model_map_read;
+    loader.eof = model_map_eof;
+    loader.close = model_map_close;
+
+    wctx = whisper_init_with_params_no_state(&loader, cparams);
+    *file_size = st.st_size;
+out:
+    if(data != MAP_FAILED) {
+        munmap(data, st.st_size);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    return wctx;
+}
+#endif
+
+/* the mmap loader when asked for and available, whisper's own file loader otherwise */
+struct whisper_context *model_load(wasr_model_t *model, struct whisper_context_params cparams, uint8_t fl_mmap, uint8_t fl_populate) {
+    struct whisper_context *wctx = NULL;
+    switch_time_t started = switch_micro_time_now();
+
+#ifdef __linux__
+    if(fl_mmap && (wctx = model_load_mmap(model->file, cparams, fl_populate, &model->file_size)) == NULL) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unable to map model: %s (trying without mmap)\n", model->file);
+    }
+#endif
+    if(!wctx) {
+        wctx = whisper_init_from_file_with_params_no_state(model->file, cparams);
+    }
+
+    model->load_us = (switch_micro_time_now() - started);
+    return wctx;
+}
+
+/* resident and resident file-backed bytes of this process (statm 'shared': libraries and mapped files) */
+switch_status_t proc_mem_stat(uint64_t *rss, uint64_t *file) {
+#ifdef __linux__
+    unsigned long size = 0, resident = 0, share = 0;
+    long page = sysconf(_SC_PAGESIZE);
+    FILE *fp = NULL;
+    int n = 0;
+
+    if((fp = fopen("/proc/self/statm", "r")) == NULL) {
+        return SWITCH_STATUS_FALSE;
+    }
+    n = fscanf(fp, "%lu %lu %lu", &size, &resident, &share);
+    fclose(fp);
+
+    if(n != 3) {
+        return SWITCH_STATUS_FALSE;
+    }
+    *rss = ((uint64_t)resident * page);
+    *file = ((uint64_t)share * page);
+
+    return SWITCH_STATUS_SUCCESS;
+#else
+    return SWITCH_STATUS_NOTIMPL;
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+// model sets
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+static void model_set_free(wasr_model_set_t *mset) {
+    switch_memory_pool_t *pool = mset->pool;
+
+    for(uint32_t i = 0; i < mset->count; i++) {
+        if(mset->models[i].wctx) {
+            whisper_free(mset->models[i].wctx);
+            mset->models[i].wctx = NULL;
+        }
+    }
+    if(mset->gen) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Model set #%u released\n", mset->gen);
+    }
+
+    // the set lives in its own pool
+    switch_core_destroy_memory_pool(&pool);
+}
+
+/* an empty set with the 'default' slot, the caller holds the only reference */
+switch_status_t model_set_create(wasr_model_set_t **out) {
+    switch_memory_pool_t *pool = NULL;
+    wasr_model_set_t *mset = NULL;
+
+    if(switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+        return SWITCH_STATUS_MEMERR;
+    }
+    if((mset = switch_core_alloc(pool, sizeof(wasr_model_set_t))) == NULL) {
+        switch_core_destroy_memory_pool(&pool);
+        return SWITCH_STATUS_MEMERR;
+    }
+
+    mset->pool = pool;
+    mset->refs = 1;
+    mset->count = 1;
+    mset->models[0].name = "default";
+
+    *out = mset;
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* loads every model of the set with the gpu settings of 'globals', the weight type (f16, q5_1, q8_0...) comes with the file */
+switch_status_t model_set_load(wasr_model_set_t *mset, globals_t *globals) {
+    struct whisper_context_params cparams = {0};
+
+    for(uint32_t i = 0; i < mset->count; i++) {
+        wasr_model_t *model = &mset->models[i];
+
+        cparams = whisper_context_default_params();
+        cparams.use_gpu = globals->whisper_use_gpu;
+        cparams.gpu_device = globals->whisper_gpu_dev;
+        cparams.flash_attn = model->fl_flash_attn;
+
+        if((model->wctx = model_load(model, cparams, globals->fl_model_mmap, globals->fl_model_populate)) == NULL) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to load model: %s\n", model->file);
+            return SWITCH_STATUS_GENERR;
+        }
+        mset->load_us += model->load_us;
+    }
+
+    return SWITCH_STATUS_SUCCESS;
+}
+
+/* one short inference per model on a throwaway state, pages the weights in before the set takes traffic */
+void model_set_warmup(wasr_model_set_t *mset, globals_t *globals) {
+    const uint32_t samples = (WHISPER_SAMPLE_RATE * WARMUP_AUDIO_MS) / 1000;
+    struct whisper_full_params wparams = warmup_params(globals);
+    struct whisper_state *wstate = NULL;
+    float *audio = NULL;
+
+    switch_zmalloc(audio, samples * sizeof(float));
+
+    for(uint32_t i = 0; i < mset->count && !globals->fl_shutdown; i++) {
+        if(!mset->models[i].wctx || (wstate = whisper_init_state(mset->models[i].wctx)) == NULL) {
+            continue;
+        }
+        if(whisper_full_with_state(mset->models[i].wctx, wstate, wparams, audio, samples) != 0) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Warm-up inference failed (%s)\n", mset->models[i].name);
+        }
+        whisper_free_state(wstate);
+    }
+
+    switch_safe_free(audio);
+}
+
+/* the current set with a reference taken, under the lock so a concurrent swap can't free it in between */
+wasr_model_set_t *model_set_acquire(globals_t *globals) {
+    wasr_model_set_t *mset = NULL;
+
+    switch_mutex_lock(globals->mutex);
+    if((mset = globals->mset)) {
+        __atomic_add_fetch(&mset->refs, 1, __ATOMIC_RELAXED);
+    }
+    switch_mutex_unlock(globals->mutex);
+
+    return mset;
+}
+
+/* one more reference on a set the caller already holds */
+void model_set_ref(wasr_model_set_t *mset) {
+    __atomic_add_fetch(&mset->refs, 1, __ATOMIC_RELAXED);
+}
+
+void model_set_release(wasr_model_set_t *mset) {
+    if(mset && __atomic_sub_fetch(&mset->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        model_set_free(mset);
+    }
+}
+
+/* makes mset the current set (takes over the caller's reference), the old one goes once its last user lets it go */
+void model_set_swap(globals_t *globals, wasr_model_set_t *mset) {
+    wasr_model_set_t *old = NULL;
+
+    switch_mutex_lock(globals->mutex);
+    old = globals->mset;
+    mset->gen = (old ? old->gen + 1 : 1);
+
+    // counters go on under the same model name
+    for(uint32_t i = 0; old && i < mset->count; i++) {
+        wasr_model_t *prev = model_set_lookup(old, mset->models[i].name);
+        if(prev) {
+            mset->models[i].routed = prev->routed;
+            mset->models[i].forced = prev->forced;
+            mset->models[i].audio_us = prev->audio_us;
+            mset->models[i].inference_us = prev->inference_us;
+        }
+    }
+
+    globals->mset = mset;
+    __atomic_store_n(&globals->mset_gen, mset->gen, __ATOMIC_RELEASE);
+    switch_mutex_unlock(globals->mutex);
+
+    model_set_release(old);
+}
+
+wasr_model_t *model_set_lookup(wasr_model_set_t *mset, const char *name) {
+    for(uint32_t i = 0; i < mset->count; i++) {
+        if(!strcasecmp(mset->models[i].name, name)) {
+            return &mset->models[i];
+        }
+    }
+    return NULL;
+}
+
+/* per inference bookkeeping, shared by the whisper callbacks */
+typedef struct {
+    wasr_job_t              *jobs;
+    uint32_t                count;
+    switch_time_t           enc_start;
+    switch_time_t           dec_start;
+    uint64_t                budget_us;      // decode-budget-ms, 0 = none
+    uint64_t                enc_us;
+    uint64_t                dec_us;
+    uint32_t                fallbacks;
+    int                     pass_tokens;    // longest sequence of the window's current pass, -1 until its first logits
+    uint8_t                 fl_aborted;
+    uint8_t                 fl_budget_hit;
+} transcribe_run_t;
+
+/* a packed run is only worth aborting when every job in it has been cancelled */
+static uint8_t transcribe_run_aborted(transcribe_run_t *run) {
+    if(!run->fl_aborted) {
+        for(uint32_t i = 0; i < run->count; i++) {
+            if(!job_cancelled(&run->jobs[i])) { return SWITCH_FALSE; }
+        }
+        run->fl_aborted = SWITCH_TRUE;
+    }
+    return SWITCH_TRUE;
+}
+
+/* polled by ggml between graph nodes, so a cancelled job stops in the middle of the encoder or a decoder pass */
+static bool xxx_whisper_abort_callback(void *udata) {
+    return (transcribe_run_aborted((transcribe_run_t *)udata) ? true : false);
+}
+
+static bool xxx_whisper_encoder_begin_callback(struct whisper_context *ctx, struct whisper_state *state, void *udata) {
+    transcribe_run_t *run = (transcribe_run_t *)udata;
+    switch_time_t now = switch_micro_time_now();
+
+    if(run->dec_start) {
+        run->dec_us += (now - run->dec_start);
+        run->dec_start = 0;
+    }
+    run->enc_start = now;
+    run->pass_tokens = -1;
+
+    return(transcribe_run_aborted(run) ? false : true);
+}
+
+/*
+ * the first logits after an encode mark the start of decoding.
+ * fallbacks: every window is encoded once and all its decoders start a pass together on empty sequences,
+ * so an empty sequence once the window's pass went past its first step is the same window decoded again
+ * at the next temperature (a pass that ended on its first step goes uncounted).
+ * budget: counted on decoding time only; past it only end-of-text is left, so every decoder closes the
+ * hypothesis it has. whisper keeps the pass it is in, if that is a fallback its text is the truncated one
+ */
+static void xxx_whisper_logits_filter_callback(struct whisper_context *ctx, struct whisper_state *state, const whisper_token_data *tokens, int n_tokens, float *logits, void *udata) {
+    transcribe_run_t *run = (transcribe_run_t *)udata;
+    switch_time_t now = switch_micro_time_now();
+
+    if(run->enc_start) {
+        run->enc_us += (now - run->enc_start);
+        run->enc_start = 0;
+        run->dec_start = now;
+    }
+
+    if(n_tokens == 0 && run->pass_tokens > 0) {
+        run->fallbacks++;
+        run->pass_tokens = 0;
+    }
+    run->pass_tokens = MAX(run->pass_tokens, n_tokens);
+
+    if(run->budget_us && logits && (run->dec_us + (now - run->dec_start)) >= run->budget_us) {
+        whisper_token eot = whisper_token_eot(ctx);
+        int n_vocab = whisper_n_vocab(ctx);
+
+        for(int i = 0; i < n_vocab; i++) {
+            if(i != eot) { logits[i] = -INFINITY; }
+        }
+        run->fl_budget_hit = SWITCH_TRUE;
+    }
+}
+
+static void transcribe_run_begin(transcribe_run_t *run, struct whisper_full_params *wparams) {
+    uint32_t budget_ms = 0;
+
+    // a packed run ends with its tightest budget
+    for(uint32_t i = 0; i < run->count; i++) {
+        uint32_t ms = run->jobs[i].asr_ctx->decode_budget_ms;
+        if(ms && (!budget_ms || ms < budget_ms)) { budget_ms = ms; }
+    }
+    run->budget_us = ((uint64_t)budget_ms * 1000);
+    run->pass_tokens = -1;
+
+    wparams->encoder_begin_callback_user_data = run;
+    wparams->encoder_begin_callback = (whisper_encoder_begin_callback) xxx_whisper_encoder_begin_callback;
+    wparams->logits_filter_callback_user_data = run;
+    wparams->logits_filter_callback = (whisper_logits_filter_callback) xxx_whisper_logits_filter_callback;
+    wparams->abort_callback_user_data = run;
+    wparams->abort_callback = (ggml_abort_callback) xxx_whisper_abort_callback;
+}
+
+static void transcribe_run_end(transcribe_run_t *run, switch_time_t started, uint32_t samples, globals_t *globals) {
+    switch_time_t now = switch_micro_time_now();
+    metrics_t *metrics = &globals->metrics;
+
+    if(run->dec_start) {
+        run->dec_us += (now - run->dec_start);
+    }
+
+    metrics_hist_add(&metrics->stages[METRICS_STAGE_ENCODE], run->enc_us);
+    metrics_hist_add(&metrics->stages[METRICS_STAGE_DECODE], run->dec_us);
+    metrics_hist_add(&metrics->stages[METRICS_STAGE_INFERENCE], (now - started));
+    metrics_add(&metrics->inference_us, (now - started));
+    metrics_add(&metrics->audio_us, ((uint64_t)samples * 1000000 / WHISPER_SAMPLE_RATE));
+    if(run->fallbacks) {
+        metrics_add(&metrics->decode_fallbacks, run->fallbacks);
+    }
+    if(run->fl_budget_hit) {
+        metrics_add(&metrics->decode_budget_hits, 1);
+    }
+
+    for(uint32_t i = 0; i < run->count; i++) {
+        run->jobs[i].inference_us = (now - started);
+    }
+}
+
+static struct whisper_full_params transcribe_params(wasr_job_t *job, uint32_t samples, uint32_t n_threads, globals_t *globals) {
+    wasr_ctx_t *asr_ctx = job->asr_ctx;
+    struct whisper_full_params wparams = whisper_full_default_params(asr_ctx->whisper_beam_size ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
+
+    wparams.print_progress   = false;
+    wparams.print_special    = false;
+    wparams.print_realtime   = false;
+    wparams.print_timestamps = false;
+    wparams.translate        = asr_ctx->whisper_translate;
+    wparams.single_segment   = asr_ctx->whisper_single_segment;
+    wparams.max_tokens       = asr_ctx->whisper_max_tokens;
+    wparams.no_context       = asr_ctx->whisper_no_context;
+    wparams.language         = asr_ctx->lang ? asr_ctx->lang : DEF_LANG;
+    wparams.n_threads        = n_threads;
+    wparams.audio_ctx        = audio_ctx_calc(asr_ctx->audio_ctx, samples, globals->audio_ctx_min, globals->audio_ctx_pad, whisper_model_n_audio_ctx(job->wctx));
+
+    if(asr_ctx->whisper_beam_size) {
+        wparams.beam_search.beam_size = asr_ctx->whisper_beam_size;
+    }
+
+    // whisper decodes a failed window again at temperature + inc up to 1.0, the step is widened so that it takes at most max-fallbacks passes
+    wparams.temperature_inc = (asr_ctx->whisper_max_fallbacks ? MAX(asr_ctx->whisper_temperature_inc, 0.0f) : 0.0f);
+    if(wparams.temperature_inc > 0.0f && (1.0f - wparams.temperature) / wparams.temperature_inc > asr_ctx->whisper_max_fallbacks) {
+        wparams.temperature_inc = (1.0f - wparams.temperature) / asr_ctx->whisper_max_fallbacks;
+    }
+
+    return wparams;
+}
+
+/* jobs that decode with different settings can't share a whisper_full */
+uint8_t decode_params_equal(wasr_ctx_t *a, wasr_ctx_t *b) {
+    return (a->whisper_beam_size == b->whisper_beam_size && a->whisper_max_fallbacks == b->whisper_max_fallbacks &&
+            a->whisper_temperature_inc == b->whisper_temperature_inc && a->whisper_no_context == b->whisper_no_context);
+}
+
+/* whisper_full failed: SWITCH_STATUS_BREAK when the jobs were cancelled under it */
+static switch_status_t transcribe_run_failed(transcribe_run_t *run, globals_t *globals) {
+    if(run->fl_aborted) {
+        metrics_add(&globals->metrics.inferences_aborted, 1);
+        return SWITCH_STATUS_BREAK;
+    }
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "whisper_full_with_state()\n");
+    return SWITCH_STATUS_FALSE;
+}
+
+/*
+ * lang=auto: the language is scored here with its probability and whisper_full decodes in it,
+ * whisper's own auto mode runs the same extra encoder pass but keeps the probability to itself.
+ * the mel only covers the audio_ctx window of the (trimmed) chunk, the encoder doesn't look past it
+ */
+static void transcribe_lang_detect(wasr_job_t *job, uint32_t n_threads, struct whisper_full_params *wparams, globals_t *globals) {
+    uint32_t samples = job->samples;
+    float *probs = NULL;
+    int lang_id = -1;
+
+    if(wparams->audio_ctx > 0) {
+        samples = MIN(samples, ((uint32_t)wparams->audio_ctx * (WHISPER_SAMPLE_RATE / AUDIO_CTX_FRAMES_SEC)));
+    }
+
+    switch_zmalloc(probs, (whisper_lang_max_id() + 1) * sizeof(float));
+
+    if(whisper_pcm_to_mel_with_state(job->wctx, job->wstate, job->audio, samples, n_threads) == 0) {
+        if((lang_id = whisper_lang_auto_detect_with_state(job->wctx, job->wstate, 0, n_threads, probs)) >= 0) {
+            job->lang_id = lang_id;
+            job->lang_p = probs[lang_id];
+            wparams->language = whisper_lang_str(lang_id);
+            metrics_add(&globals->metrics.lang_detections, 1);
+        }
+    }
+    if(lang_id < 0) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "whisper_lang_auto_detect_with_state()\n");
+    }
+
+    switch_safe_free(probs);
+}
+
+/* where the job audio starts in its chunk, after trim-silence and the vad gate */
+static int64_t job_audio_ms(wasr_job_t *job) {
+    return (job->buffer ? ((int64_t)(job->audio - job->buffer) * 1000 / WHISPER_SAMPLE_RATE) : 0);
+}
+
+/*
+ * a segment as one line of the text buffer (the same goes over the remote protocol):
+ * t0_ms \t t1_ms \t avg token p \t lang \t text, whisper times are in 10 ms units
+ */
+static void segment_write(switch_buffer_t *buf, struct whisper_state *wstate, int i, int64_t shift_ms) {
+    const char *text = whisper_full_get_segment_text_from_state(wstate, i);
+    int lang_id = whisper_full_lang_id_from_state(wstate);
+    int tokens = whisper_full_n_tokens_from_state(wstate, i);
+    double p = 0.0;
+    char hdr[128];
+    int len = 0;
+
+    if(!text) {
+        return;
+    }
+    for(int j = 0; j < tokens; j++) {
+        p += whisper_full_get_token_p_from_state(wstate, i, j);
+    }
+    len = snprintf(hdr, sizeof(hdr), "%"SWITCH_INT64_T_FMT"\t%"SWITCH_INT64_T_FMT"\t%.3f\t%s\t",
+        (whisper_full_get_segment_t0_from_state(wstate, i) * 10 + shift_ms), (whisper_full_get_segment_t1_from_state(wstate, i) * 10 + shift_ms),
+        (tokens ? (p / tokens) : 0.0), (lang_id >= 0 ? whisper_lang_str(lang_id) : ""));
+
+    switch_buffer_write(buf, hdr, len);
+    for(; *text; text++) {
+        switch_buffer_write(buf, ((*text == '\n' || *text == '\t') ? " " : text), 1);
+    }
+    switch_buffer_write(buf, "\n", 1);
+}
+
+/* reads the next segment line in place (the buffer is changed), SWITCH_FALSE at the end */
+uint8_t segment_parse(char **cursor, wasr_segment_t *seg) {
+    char *fields[5] = {0};
+    char *p = *cursor, *eol = NULL;
+
+    while(p && *p) {
+        if((eol = strchr(p, '\n'))) { *eol = '\0'; }
+        *cursor = (eol ? eol + 1 : NULL);
+
+        fields[0] = p;
+        for(uint32_t i = 1; i < 5 && fields[i - 1]; i++) {
+            if((fields[i] = strchr(fields[i - 1], '\t'))) { *fields[i]++ = '\0'; }
+        }
+        if(fields[4]) {
+            seg->t0 = strtoll(fields[0], NULL, 10);
+            seg->t1 = strtoll(fields[1], NULL, 10);
+            seg->p = strtod(fields[2], NULL);
+            seg->lang = fields[3];
+            seg->text = fields[4];
+            return SWITCH_TRUE;
+        }
+        p = *cursor;
+    }
+
+    return SWITCH_FALSE;
+}
+
+switch_status_t transcribe(wasr_job_t *job, uint32_t n_threads, globals_t *globals) {
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+    struct whisper_full_params wparams = {0};
+    transcribe_run_t run = { .jobs = job, .count = 1 };
+    switch_time_t started = 0;
+    int segments = 0;
+
+    if(!job->wctx || !job->wstate) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "(wctx == NULL || wstate == NULL)\n");
+        return SWITCH_STATUS_FALSE;
+    }
+
+    wparams = transcribe_params(job, job->samples, n_threads, globals);
+
+    job->lang_id = -1;
+    job->lang_p = 0.0f;
+    // partials run in the default language until a final has locked the call's one
+    if(!strcasecmp(wparams.language, LANG_AUTO)) {
+        if(job->fl_final) {
+            transcribe_lang_detect(job, n_threads, &wparams, globals);
+        } else {
+            wparams.language = DEF_LANG;
+        }
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "transcribe samples=%u, audio_ctx=%d, lang=%s\n", job->samples, wparams.audio_ctx, wparams.language);
+
+    transcribe_run_begin(&run, &wparams);
+    started = switch_micro_time_now();
+
+    if(whisper_full_with_state(job->wctx, job->wstate, wparams, job->audio, job->samples) != 0) {
+        switch_goto_status(transcribe_run_failed(&run, globals), out);
+    }
+
+    transcribe_run_end(&run, started, job->samples, globals);
+
+    if(job_cancelled(job)) {
+        switch_goto_status(SWITCH_STATUS_BREAK, out);
+    }
+
+    if((segments = whisper_full_n_segments_from_state(job->wstate))) {
+        for(int i = 0; i < segments; ++i) {
+            segment_write(job->text_buffer, job->wstate, i, job_audio_ms(job));
+        }
+    }
+out:
+    return status;
+}
+
+/* lays the jobs out back to back with gap_smps of silence in between, sets their offsets, returns the packed length */
+uint32_t jobs_pack(wasr_job_t *jobs, uint32_t count, float *buffer, uint32_t gap_smps) {
+    uint32_t packed_smps = 0;
+
+    // utterances are separated by silence, so whisper starts a new segment for each of them
+    for(uint32_t i = 0; i < count; i++) {
+        if(i > 0) {
+            memset(buffer + packed_smps, 0, gap_smps * sizeof(float));
+            packed_smps += gap_smps;
+        }
+        jobs[i].offset = packed_smps;
+        memcpy(buffer + packed_smps, jobs[i].audio, jobs[i].samples * sizeof(float));
+        packed_smps += jobs[i].samples;
+    }
+
+    return packed_smps;
+}
+
+/*
+ * runs several short utterances (already packed into 'audio' with silence between them) through one inference
+ * on the model and state of the first job. segments are given back to the jobs by their midpoint, so timestamps are forced on.
+ */
+switch_status_t transcribe_batch(wasr_job_t *jobs, uint32_t count, float *audio, uint32_t samples, uint32_t n_threads, globals_t *globals) {
+    switch_status_t status = SWITCH_STATUS_SUCCESS;
+    struct whisper_state *wstate = jobs[0].wstate;
+    struct whisper_full_params wparams = {0};
+    transcribe_run_t run = { .jobs = jobs, .count = count };
+    switch_time_t started = 0;
+    int segments = 0;
+
+    if(!jobs[0].wctx || !wstate) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "(wctx == NULL || wstate == NULL)\n");
+        return SWITCH_STATUS_FALSE;
+    }
+
+    wparams = transcribe_params(&jobs[0], samples, n_threads, globals);
+    wparams.single_segment   = false;
+    wparams.no_timestamps    = false;
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "transcribe batch jobs=%u, samples=%u, audio_ctx=%d\n", count, samples, wparams.audio_ctx);
+
+    transcribe_run_begin(&run, &wparams);
+    started = switch_micro_time_now();
+
+    if(whisper_full_with_state(jobs[0].wctx, wstate, wparams, audio, samples) != 0) {
+        switch_goto_status(transcribe_run_failed(&run, globals), out);
+    }
+
+    transcribe_run_end(&run, started, samples, globals);
+
+    if((segments = whisper_full_n_segments_from_state(wstate))) {
+        for(int i = 0; i < segments; ++i) {
+            int64_t t0 = whisper_full_get_segment_t0_from_state(wstate, i);
+            int64_t t1 = whisper_full_get_segment_t1_from_state(wstate, i);
+            uint32_t mid = (uint32_t)(((t0 + t1) / 2) * (WHISPER_SAMPLE_RATE / 100)); // timestamps are in 10ms units
+            uint32_t j = count - 1;
+
+            while(j > 0 && mid < jobs[j].offset) {
+                j--;
+            }
+            if(job_cancelled(&jobs[j])) {
+                continue;
+            }
+            // back to the times of the job's own chunk
+            segment_write(jobs[j].text_buffer, wstate, i, (job_audio_ms(&jobs[j]) - ((int64_t)jobs[j].offset * 1000 / WHISPER_SAMPLE_RATE)));
+        }
+    }
+out:
+    return status;
+}
+
+static void i2f_scaled(const int16_t *in, float *out, uint32_t samples, float scale) {
+    uint32_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 vscale = _mm256_set1_ps(scale);
+    for(; i + 16 <= samples; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), vscale));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), vscale));
+    }
+#elif defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    for(; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#endif
+    for(; i < samples; i++) {
+        out[i] = (float)in[i] * scale;
+    }
+}
+
+static void fscale(float *buf, uint32_t samples, float scale) {
+    uint32_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 vscale = _mm256_set1_ps(scale);
+    for(; i + 8 <= samples; i += 8) {
+        _mm256_storeu_ps(buf + i, _mm256_mul_ps(_mm256_loadu_ps(buf + i), vscale));
+    }
+#elif defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    for(; i + 4 <= samples; i += 4) {
+        _mm_storeu_ps(buf + i, _mm_mul_ps(_mm_loadu_ps(buf + i), vscale));
+    }
+#endif
+    for(; i < samples; i++) {
+        buf[i] *= scale;
+    }
+}
+
+void i2f(const int16_t *in, float *out, uint32_t samples) {
+    i2f_scaled(in, out, samples, I2F_SCALE);
+}
+
+/*
+ * resamples L16 straight into normalized float (whisper input) without an intermediate int16 buffer.
+ * samples go through the speex float api in pcm scale (fixed-point builds of speex would
+ * truncate normalized values) and get normalized while the output block is still in cache.
+ */
+uint32_t resample_to_float(SpeexResamplerState *resampler, const int16_t *in, uint32_t in_smps, float *out, uint32_t out_max) {
+    float tmp[RESAMPLE_BLOCK_SIZE];
+    uint32_t out_smps = 0;
+
+    while(in_smps > 0 && out_smps < out_max) {
+        spx_uint32_t ilen = MIN(in_smps, RESAMPLE_BLOCK_SIZE);
+        spx_uint32_t olen = (out_max - out_smps);
+
+        i2f_scaled(in, tmp, ilen, 1.0f);
+        speex_resampler_process_float(resampler, 0, tmp, &ilen, out + out_smps, &olen);
+        fscale(out + out_smps, olen, I2F_SCALE);
+
+        if(!ilen && !olen) {
+            break;
+        }
+
+        in += ilen; in_smps -= ilen;
+        out_smps += olen;
+    }
+
+    return out_smps;
+}
+
+switch_status_t thread_set_affinity(uint32_t cpu_first, uint32_t cpu_count) {
+#ifdef __linux__
+    uint32_t ncpu = switch_core_cpu_count();
+    cpu_set_t cpuset;
+
+    if(!ncpu || !cpu_count) {
+        return SWITCH_STATUS_FALSE;
+    }
+
+    CPU_ZERO(&cpuset);
+    for(uint32_t i = 0; i < cpu_count; i++) {
+        CPU_SET(((cpu_first + i) % ncpu), &cpuset);
+    }
+
+    return (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0 ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE);
+#else
+    return SWITCH_STATUS_NOTIMPL;
+#endif
+}
+
+/*
+ * threads for the next whisper_full: the budget is shared by the running jobs plus the queued ones
+ * the idle workers are about to pick up, within [min, max] and what is left of the budget.
+ * a single call gets the whole budget, a loaded box gets min threads per job instead of oversubscribing.
+ */
+uint32_t cpu_governor_acquire(globals_t *globals) {
+    uint32_t n_threads = 0, demand = 0, share = 0, avail = 0, min_threads = 0;
+    uint8_t fl_clamped = SWITCH_FALSE, fl_waited = SWITCH_FALSE;
+
+    if(!globals->cpu_budget) {
+        metrics_threads_add(&globals->metrics, globals->whisper_n_threads, SWITCH_FALSE);
+        return globals->whisper_n_threads;
+    }
+
+    switch_mutex_lock(globals->mutex);
+
+    // the job stays out of inference until the running ones leave it cpu-min-threads, the budget is never overdrawn
+    while(1) {
+        min_threads = MAX(MIN(globals->cpu_min_threads, globals->cpu_budget), 1);
+        avail = (globals->cpu_budget > globals->cpu_in_use ? globals->cpu_budget - globals->cpu_in_use : 0);
+        if(avail >= min_threads || !globals->cpu_running) {
+            break;
+        }
+        fl_waited = SWITCH_TRUE;
+        switch_thread_cond_wait(globals->cpu_cond, globals->mutex);
+    }
+
+    demand = MIN(globals->cpu_running + 1 + jobs_queue_size(globals->q_jobs), globals->workers);
+    share = globals->cpu_budget / MAX(demand, 1);
+
+    n_threads = MAX(MIN(share, globals->cpu_max_threads), min_threads);
+    if(avail < n_threads) {
+        n_threads = MAX(avail, min_threads);
+        fl_clamped = SWITCH_TRUE;
+    }
+
+    globals->cpu_in_use += n_threads;
+    globals->cpu_running++;
+
+    switch_mutex_unlock(globals->mutex);
+
+    metrics_threads_add(&globals->metrics, n_threads, fl_clamped);
+    if(fl_waited) {
+        metrics_add(&globals->metrics.threads_waited, 1);
+    }
+
+    return n_threads;
+}
+
+void cpu_governor_release(globals_t *globals, uint32_t n_threads) {
+    if(!globals->cpu_budget) {
+        return;
+    }
+
+    switch_mutex_lock(globals->mutex);
+    globals->cpu_in_use = (globals->cpu_in_use > n_threads ? globals->cpu_in_use - n_threads : 0);
+    if(globals->cpu_running > 0) { globals->cpu_running--; }
+    switch_thread_cond_broadcast(globals->cpu_cond);
+    switch_mutex_unlock(globals->mutex);
+}
+
+/*
+ * returns the length of the chunk without leading and trailing silence (keeps pad_ms around the speech),
+ * the same mean amplitude scale as the vad 'thresh' is used. audio without any voiced window is left as is.
+ */
+uint32_t trim_silence(const float *audio, uint32_t samples, uint32_t threshold, uint32_t pad_ms, uint32_t *offset) {
+    const uint32_t wsize = (WHISPER_SAMPLE_RATE * TRIM_WINDOW_MS) / 1000;
+    const uint32_t pad = (WHISPER_SAMPLE_RATE * pad_ms) / 1000;
+    const float thold = (float)threshold * wsize * I2F_SCALE;
+    uint32_t first = samples, last = 0;
+
+    *offset = 0;
+
+    if(!threshold || samples < wsize) {
+        return samples;
+    }
+
+    for(uint32_t i = 0; i + wsize <= samples; i += wsize) {
+        float energy = 0;
+        for(uint32_t j = 0; j < wsize; j++) {
+            energy += fabsf(audio[i + j]);
+        }
+        if(energy >= thold) {
+            if(first == samples) { first = i; }
+            last = i + wsize;
+        }
+    }
+
+    if(first == samples) {
+        return samples;
+    }
+
+    first = (first > pad ? first - pad : 0);
+    last = MIN(last + pad, samples);
+
+    *offset = first;
+    return (last - first);
+}
+
+/*
+ * neural vad (whisper.cpp silero) over a 16 kHz chunk: returns the length of the span from the first to the last
+ * speech window (keeps pad_ms around it), 0 when there is less than min_speech_ms of speech in it.
+ * if the model can't tell, the chunk is left as is.
+ */
+uint32_t vad_gate(struct whisper_vad_context *vctx, const float *audio, uint32_t samples, float threshold, uint32_t min_speech_ms, uint32_t pad_ms, uint32_t *offset) {
+    const uint32_t pad = (WHISPER_SAMPLE_RATE * pad_ms) / 1000;
+    uint32_t first = 0, last = 0, speech = 0, wsize = 0, windows = 0;
+    float *probs = NULL;
+    int n_probs = 0;
+
+    *offset = 0;
+
+    if(!whisper_vad_detect_speech(vctx, audio, samples) || (n_probs = whisper_vad_n_probs(vctx)) <= 0) {
+        return samples;
+    }
+    probs = whisper_vad_probs(vctx);
+    windows = (uint32_t)n_probs;
+    wsize = (samples + windows - 1) / windows;
+
+    first = windows;
+    for(uint32_t i = 0; i < windows; i++) {
+        if(probs[i] >= threshold) {
+            if(first == windows) { first = i; }
+            last = i + 1;
+            speech++;
+        }
+    }
+
+    if(((uint64_t)speech * wsize * 1000 / WHISPER_SAMPLE_RATE) < min_speech_ms) {
+        return 0;
+    }
+
+    first = (first * wsize > pad ? first * wsize - pad : 0);
+    last = MIN(last * wsize + pad, samples);
+
+    *offset = first;
+    return (last - first);
+}
+
+/*
+ * encoder window for the chunk: AUDIO_CTX_AUTO makes it proportional to the audio length (+pad, not less than ctx_min),
+ * 0 means the full window (1500 frames / 30 sec), any other value is used as is
+ */
+int32_t audio_ctx_calc(int32_t audio_ctx, uint32_t samples, uint32_t ctx_min, uint32_t ctx_pad, int32_t ctx_max) {
+    int32_t frames = 0;
+
+    if(audio_ctx != AUDIO_CTX_AUTO) {
+        return audio_ctx;
+    }
+
+    frames = (int32_t)(((uint64_t)samples * AUDIO_CTX_FRAMES_SEC + WHISPER_SAMPLE_RATE - 1) / WHISPER_SAMPLE_RATE) + ctx_pad;
+    frames = MAX(frames, (int32_t)ctx_min);
+
+    return (ctx_max > 0 && frames >= ctx_max) ? 0 : frames;
+}
+
+int32_t audio_ctx_parse(const char *val) {
+    if(zstr(val)) {
+        return 0;
+    }
+    if(!strcasecmp(val, "auto")) {
+        return AUDIO_CTX_AUTO;
     }
+    return MAX(atoi(val), 0);
 }
@@ -0,0 +1,517 @@
+/*
+ * Inference daemon for the remote backend of mod_whisper_asr (backend=remote).
+ * Owns the model and runs the same scheduling (sjf/priority), batching and cpu budget as the module,
+ * several FreeSWITCH nodes can share one of these. Framing is described in proto.h.
+ * Built on the core stand-in (bench/fs_standin.c), no libfreeswitch required.
+ *
+ * usage: whisper_asr_worker -m <model> -l <unix:/path | tcp:host:port> [-w workers] [-t threads] [-c cpu-budget]
+ *                           [-b batch-max-size] [-B batch-wait-ms] [-g gpu-dev] [-F] [-v]
+ *
+ *   -F   load the model with read() instead of a mapping (mmap keeps the file in the shared page cache)
+ *
+ * Module Contributor(s):
+ *  Konstantin Alexandrin <akscfx@gmail.com>
+ *
+ */
+#include "fs_standin.h"
+#include "mod_whisper_asr.h"
+#include <getopt.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+typedef struct srv_job_s srv_job_t;
+
+typedef struct {
+    switch_mutex_t          *mutex;     // sends, refs, jobs
+    srv_job_t               *jobs;      // queued or running, for CANCEL
+    int                     fd;
+    uint32_t                refs;
+} srv_conn_t;
+
+struct srv_job_s {
+    srv_job_t               *next;
+    srv_conn_t              *conn;
+    wasr_ctx_t              actx;       // the fields transcribe() reads
+    float                   *audio;
+    uint32_t                samples;
+    uint32_t                id;
+    uint16_t                flags;
+    char                    lang[sizeof(((wasr_msg_transcribe_t *)0)->lang) + 1];
+};
+
+typedef struct {
+    uint32_t                id;
+    struct whisper_state    *wstate;
+    srv_job_t               **sjobs;
+    wasr_job_t              *jobs;
+    switch_buffer_t         **text_buffers;
+    float                   *pack_buffer;
+} srv_worker_t;
+
+static globals_t globals;
+static struct {
+    switch_memory_pool_t    *pool;
+    const char              *address;
+    int                     listen_fd;
+    volatile sig_atomic_t   fl_stop;
+} server;
+
+static void signal_handler(int sig) {
+    server.fl_stop = 1;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+static void conn_release(srv_conn_t *conn) {
+    uint32_t refs = 0;
+
+    switch_mutex_lock(conn->mutex);
+    refs = --conn->refs;
+    switch_mutex_unlock(conn->mutex);
+
+    if(!refs) {
+        proto_close(conn->fd);
+        switch_safe_free(conn);
+    }
+}
+
+static void conn_reply(srv_conn_t *conn, uint32_t id, uint8_t type, const void *data, uint32_t len) {
+    wasr_msg_hdr_t hdr;
+    struct iovec iov[2];
+
+    proto_hdr_init(&hdr, type, 0, id, len);
+    iov[0].iov_base = &hdr;         iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = (void *)data; iov[1].iov_len = len;
+
+    switch_mutex_lock(conn->mutex);
+    if(conn->fd >= 0 && proto_sendv(conn->fd, iov, (len ? 2 : 1)) != SWITCH_STATUS_SUCCESS) {
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+    switch_mutex_unlock(conn->mutex);
+}
+
+/* marks the client's jobs, id 0 = all of them (the client went away) */
+static void conn_cancel(srv_conn_t *conn, uint32_t id) {
+    switch_mutex_lock(conn->mutex);
+    for(srv_job_t *sjob = conn->jobs; sjob; sjob = sjob->next) {
+        if(!id || sjob->id == id) {
+            sjob->actx.fl_abort = SWITCH_TRUE;
+        }
+    }
+    switch_mutex_unlock(conn->mutex);
+}
+
+static void job_free(srv_job_t *sjob) {
+    srv_conn_t *conn = sjob->conn;
+
+    switch_mutex_lock(conn->mutex);
+    for(srv_job_t **pp = &conn->jobs; *pp; pp = &(*pp)->next) {
+        if(*pp == sjob) { *pp = sjob->next; break; }
+    }
+    switch_mutex_unlock(conn->mutex);
+
+    conn_release(conn);
+    switch_safe_free(sjob->audio);
+    switch_safe_free(sjob);
+}
+
+/* same ordering as the module: short chunks first, aged in after sched-max-age-ms, priority shifts */
+static int64_t job_key(srv_job_t *sjob) {
+    int64_t now = switch_micro_time_now();
+    int64_t cost_ms = ((int64_t)sjob->samples * 1000 / WHISPER_SAMPLE_RATE);
+
+    return now + MIN(cost_ms * globals.sched_cost_weight, (int64_t)globals.sched_max_age_ms * 1000)
+               - ((int64_t)sjob->actx.priority * globals.sched_prio_step_ms * 1000);
+}
+
+static uint8_t job_batch_eligible(srv_job_t *lead, srv_job_t *sjob, uint32_t packed_smps) {
+    if(!(sjob->flags & WASR_FLAG_FINAL) || sjob->samples > globals.batch_max_job_smps) {
+        return SWITCH_FALSE;
+    }
+    if(sjob == lead) {
+        return SWITCH_TRUE;
+    }
+    if(packed_smps + globals.batch_gap_smps + sjob->samples > BATCH_MAX_SAMPLES) {
+        return SWITCH_FALSE;
+    }
+    // lang=auto is detected per request, it can't share a run
+    if(!strcmp(lead->lang, LANG_AUTO) || !strcmp(sjob->lang, LANG_AUTO)) {
+        return SWITCH_FALSE;
+    }
+    if(!decode_params_equal(&lead->actx, &sjob->actx)) {
+        return SWITCH_FALSE;
+    }
+    return ((lead->flags & WASR_FLAG_TRANSLATE) == (sjob->flags & WASR_FLAG_TRANSLATE) && !strcmp(lead->lang, sjob->lang));
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+static void worker_run(srv_worker_t *worker, srv_job_t **sjobs, uint32_t count) {
+    switch_status_t status = SWITCH_STATUS_FALSE;
+    wasr_job_t *jobs = worker->jobs;
+    uint32_t n_threads = 0, kept = 0;
+
+    // cancelled while queued, nobody waits for these anymore
+    for(uint32_t i = 0; i < count; i++) {
+        if(sjobs[i]->actx.fl_abort) {
+            metrics_add(&globals.metrics.jobs_cancelled, 1);
+            conn_reply(sjobs[i]->conn, sjobs[i]->id, WASR_MSG_ERROR, "cancelled", 9);
+            job_free(sjobs[i]);
+        } else {
+            sjobs[kept++] = sjobs[i];
+        }
+    }
+    if(!(count = kept)) {
+        return;
+    }
+
+    n_threads = cpu_governor_acquire(&globals);
+
+    for(uint32_t i = 0; i < count; i++) {
+        switch_buffer_zero(worker->text_buffers[i]);
+
+        memset(&jobs[i], 0, sizeof(wasr_job_t));
+        jobs[i].asr_ctx = &sjobs[i]->actx;
+        jobs[i].wctx = globals.wctx;
+        jobs[i].wstate = worker->wstate;
+        jobs[i].text_buffer = worker->text_buffers[i];
+        jobs[i].audio = sjobs[i]->audio;
+        jobs[i].samples = sjobs[i]->samples;
+        jobs[i].fl_final = ((sjobs[i]->flags & WASR_FLAG_FINAL) != 0);
+    }
+
+    if(count == 1) {
+        status = transcribe(&jobs[0], n_threads, &globals);
+    } else {
+        uint32_t packed_smps = jobs_pack(jobs, count, worker->pack_buffer, globals.batch_gap_smps);
+        status = transcribe_batch(jobs, count, worker->pack_buffer, packed_smps, n_threads, &globals);
+
+        metrics_add(&globals.metrics.batch_runs, 1);
+        metrics_add(&globals.metrics.batch_jobs, count);
+    }
+
+    cpu_governor_release(&globals, n_threads);
+
+    for(uint32_t i = 0; i < count; i++) {
+        if(job_cancelled(&jobs[i])) {
+            metrics_add(&globals.metrics.jobs_cancelled, 1);
+            conn_reply(sjobs[i]->conn, sjobs[i]->id, WASR_MSG_ERROR, "cancelled", 9);
+        } else if(status == SWITCH_STATUS_SUCCESS) {
+            const void *text = NULL;
+            switch_size_t len = switch_buffer_peek_zerocopy(jobs[i].text_buffer, &text);
+            conn_reply(sjobs[i]->conn, sjobs[i]->id, WASR_MSG_RESULT, text, (uint32_t)len);
+            metrics_add(&globals.metrics.results, 1);
+        } else {
+            conn_reply(sjobs[i]->conn, sjobs[i]->id, WASR_MSG_ERROR, "transcription failed", 20);
+        }
+        job_free(sjobs[i]);
+    }
+}
+
+static void *SWITCH_THREAD_FUNC worker_thread(switch_thread_t *thread, void *obj) {
+    srv_worker_t *worker = (srv_worker_t *)obj;
+    srv_job_t **sjobs = worker->sjobs;
+    void *pop = NULL;
+
+    while(!globals.fl_shutdown) {
+        srv_job_t *deferred = NULL;
+        uint32_t count = 1, packed_smps = 0;
+        switch_time_t deadline = 0;
+
+        if(jobs_queue_pop_timeout(globals.q_jobs, &pop, WORKER_IDLE_TIMEOUT) != SWITCH_STATUS_SUCCESS || !pop) {
+            continue;
+        }
+
+        sjobs[0] = (srv_job_t *)pop;
+        packed_smps = sjobs[0]->samples;
+        deadline = switch_micro_time_now() + (globals.batch_wait_ms * 1000);
+
+        while(globals.batch_max_size > 1 && count < globals.batch_max_size && job_batch_eligible(sjobs[0], sjobs[0], 0)) {
+            switch_time_t now = switch_micro_time_now();
+
+            if(now >= deadline || jobs_queue_pop_timeout(globals.q_jobs, &pop, (deadline - now)) != SWITCH_STATUS_SUCCESS || !pop) {
+                break;
+            }
+            if(!job_batch_eligible(sjobs[0], (srv_job_t *)pop, packed_smps)) {
+                deferred = (srv_job_t *)pop;
+                break;
+            }
+            sjobs[count] = (srv_job_t *)pop;
+            packed_smps += globals.batch_gap_smps + sjobs[count]->samples;
+            count++;
+        }
+
+        worker_run(worker, sjobs, count);
+        if(deferred) {
+            sjobs[0] = deferred;
+            worker_run(worker, sjobs, 1);
+        }
+    }
+
+    switch_mutex_lock(globals.mutex);
+    globals.active_threads--;
+    switch_mutex_unlock(globals.mutex);
+
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+/* reads the requests of one client, the audio lands straight in the job buffer */
+static void *SWITCH_THREAD_FUNC conn_thread(switch_thread_t *thread, void *obj) {
+    srv_conn_t *conn = (srv_conn_t *)obj;
+    wasr_msg_transcribe_t body;
+    wasr_msg_hdr_t hdr;
+
+    while(!globals.fl_shutdown) {
+        srv_job_t *sjob = NULL;
+
+        if(proto_recv(conn->fd, &hdr, sizeof(hdr)) != SWITCH_STATUS_SUCCESS) {
+            break;
+        }
+        if(proto_hdr_check(&hdr) != SWITCH_STATUS_SUCCESS) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Malformed request, closing the connection\n");
+            break;
+        }
+        if(hdr.type == WASR_MSG_CANCEL && !hdr.len) {
+            conn_cancel(conn, hdr.id);
+            continue;
+        }
+        if(hdr.type != WASR_MSG_TRANSCRIBE || hdr.len < sizeof(body)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Malformed request, closing the connection\n");
+            break;
+        }
+        if(proto_recv(conn->fd, &body, sizeof(body)) != SWITCH_STATUS_SUCCESS) {
+            break;
+        }
+        if(hdr.len != sizeof(body) + (uint64_t)body.samples * sizeof(float)) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid request length (id=%u)\n", hdr.id);
+            break;
+        }
+
+        switch_zmalloc(sjob, sizeof(srv_job_t));
+        switch_malloc(sjob->audio, MAX(body.samples, 1) * sizeof(float));
+        if(body.samples && proto_recv(conn->fd, sjob->audio, body.samples * sizeof(float)) != SWITCH_STATUS_SUCCESS) {
+            switch_safe_free(sjob->audio);
+            switch_safe_free(sjob);
+            break;
+        }
+
+        memcpy(sjob->lang, body.lang, sizeof(body.lang));
+        sjob->id = hdr.id;
+        sjob->flags = hdr.flags;
+        sjob->samples = body.samples;
+        sjob->actx.lang = (sjob->lang[0] ? sjob->lang : NULL);
+        sjob->actx.audio_ctx = body.audio_ctx;
+        sjob->actx.priority = body.priority;
+        sjob->actx.whisper_max_tokens = body.max_tokens;
+        sjob->actx.whisper_translate = ((hdr.flags & WASR_FLAG_TRANSLATE) != 0);
+        sjob->actx.whisper_single_segment = ((hdr.flags & WASR_FLAG_SINGLE_SEGMENT) != 0);
+        sjob->actx.whisper_no_context = ((hdr.flags & WASR_FLAG_NO_CONTEXT) != 0);
+        sjob->actx.whisper_beam_size = body.beam_size;
+        sjob->actx.whisper_max_fallbacks = body.max_fallbacks;
+        sjob->actx.whisper_temperature_inc = body.temperature_inc;
+        sjob->actx.decode_budget_ms = body.decode_budget_ms;
+
+        switch_mutex_lock(conn->mutex);
+        conn->refs++;
+        sjob->next = conn->jobs;
+        conn->jobs = sjob;
+        switch_mutex_unlock(conn->mutex);
+        sjob->conn = conn;
+
+        if(!sjob->samples) {
+            conn_reply(conn, sjob->id, WASR_MSG_RESULT, NULL, 0);
+            job_free(sjob);
+            continue;
+        }
+
+        metrics_add(&globals.metrics.jobs, 1);
+        if(jobs_queue_push(globals.q_jobs, sjob, job_key(sjob)) != SWITCH_STATUS_SUCCESS) {
+            metrics_add(&globals.metrics.jobs_rejected, 1);
+            conn_reply(conn, sjob->id, WASR_MSG_ERROR, "queue full", 10);
+            job_free(sjob);
+        }
+    }
+
+    // the module has dropped these requests along with the connection
+    conn_cancel(conn, 0);
+    shutdown(conn->fd, SHUT_RDWR);
+    conn_release(conn);
+
+    return NULL;
+}
+
+static void server_accept(int fd) {
+    switch_threadattr_t *attr = NULL;
+    switch_thread_t *thread = NULL;
+    srv_conn_t *conn = NULL;
+
+    switch_zmalloc(conn, sizeof(srv_conn_t));
+    conn->fd = fd;
+    conn->refs = 1;
+    switch_mutex_init(&conn->mutex, SWITCH_MUTEX_NESTED, server.pool);
+
+    switch_threadattr_create(&attr, server.pool);
+    switch_threadattr_detach_set(attr, 1);
+    switch_threadattr_stacksize_set(attr, SWITCH_THREAD_STACKSIZE);
+    if(switch_thread_create(&thread, attr, conn_thread, conn, server.pool) != SWITCH_STATUS_SUCCESS) {
+        conn_release(conn);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------------------------------
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s -m model -l unix:/path|tcp:host:port [-w workers] [-t threads] [-c cpu-budget] [-b batch-max-size] [-B batch-wait-ms] [-g gpu-dev] [-F] [-v]\n", name);
+}
+
+int main(int argc, char **argv) {
+    struct whisper_context_params cparams = whisper_context_default_params();
+    struct sigaction sa = { 0 };
+    switch_threadattr_t *attr = NULL;
+    switch_thread_t *thread = NULL;
+    wasr_model_t model = { .name = "default" };
+    uint32_t ncpu = 0;
+    uint8_t fl_verbose = SWITCH_FALSE, fl_mmap = SWITCH_TRUE;
+    int opt = 0, gpu_dev = -1;
+
+    memset(&globals, 0, sizeof(globals));
+    memset(&server, 0, sizeof(server));
+    server.listen_fd = -1;
+
+    metrics_init(&globals.metrics);
+    globals.audio_ctx_min = DEF_AUDIO_CTX_MIN;
+    globals.audio_ctx_pad = DEF_AUDIO_CTX_PAD;
+    globals.sched_cost_weight = DEF_SCHED_COST_WEIGHT;
+    globals.sched_max_age_ms = DEF_SCHED_MAX_AGE_MS;
+    globals.sched_prio_step_ms = DEF_SCHED_PRIO_STEP_MS;
+    globals.batch_max_size = 1;
+    globals.batch_wait_ms = DEF_BATCH_WAIT_MS;
+    globals.batch_max_job_smps = (DEF_BATCH_MAX_JOB_MS * (WHISPER_SAMPLE_RATE / 1000));
+    globals.batch_gap_smps = (DEF_BATCH_GAP_MS * (WHISPER_SAMPLE_RATE / 1000));
+
+    while((opt = getopt(argc, argv, "m:l:w:t:c:b:B:g:Fv")) != -1) {
+        switch(opt) {
+            case 'm': model.file = optarg; break;
+            case 'l': server.address = optarg; break;
+            case 'w': globals.workers = atoi(optarg); break;
+            case 't': globals.whisper_n_threads = atoi(optarg); break;
+            case 'c': globals.cpu_budget = (strcasecmp(optarg, "auto") ? (uint32_t)atoi(optarg) : UINT32_MAX); break;
+            case 'b': globals.batch_max_size = MAX(atoi(optarg), 1); break;
+            case 'B': globals.batch_wait_ms = atoi(optarg); break;
+            case 'g': gpu_dev = atoi(optarg); break;
+            case 'F': fl_mmap = SWITCH_FALSE; break;
+            case 'v': fl_verbose = SWITCH_TRUE; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if(!model.file || !server.address) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    standin_init(NULL, (fl_verbose ? SWITCH_LOG_DEBUG : SWITCH_LOG_NOTICE));
+    switch_core_new_memory_pool(&server.pool);
+    switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, server.pool);
+    switch_thread_cond_create(&globals.cpu_cond, server.pool);
+
+    ncpu = MAX(switch_core_cpu_count(), 1);
+    globals.whisper_n_threads = MIN((globals.whisper_n_threads ? globals.whisper_n_threads : ncpu), ncpu);
+    if(globals.cpu_budget) {
+        globals.cpu_budget = MIN(globals.cpu_budget, ncpu);
+        globals.cpu_min_threads = MIN(DEF_CPU_MIN_THREADS, globals.cpu_budget);
+        globals.cpu_max_threads = globals.cpu_budget;
+        globals.workers = (globals.workers ? globals.workers : MAX(globals.cpu_budget / globals.cpu_min_threads, 1));
+    } else {
+        globals.workers = (globals.workers ? globals.workers : MAX(ncpu / globals.whisper_n_threads, 1));
+    }
+
+    if(gpu_dev >= 0) {
+        cparams.use_gpu = true;
+        cparams.gpu_device = gpu_dev;
+    } else {
+        cparams.use_gpu = false;
+    }
+
+    // with mmap the file pages stay in the page cache, a restart or a second worker loads from memory
+    if((globals.wctx = model_load(&model, cparams, fl_mmap, SWITCH_TRUE)) == NULL) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to load model: %s\n", model.file);
+        return 1;
+    }
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Model loaded in %"SWITCH_UINT64_T_FMT" ms (%s)\n", (model.load_us / 1000), (fl_mmap ? "mmap" : "file"));
+    if(jobs_queue_create(&globals.q_jobs, JOBS_QUEUE_SIZE, server.pool) != SWITCH_STATUS_SUCCESS) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "jobs_queue_create()\n");
+        return 1;
+    }
+    if((server.listen_fd = proto_listen(server.address)) < 0) {
+        switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Unable to listen on %s\n", server.address);
+        return 1;
+    }
+
+    for(uint32_t i = 0; i < globals.workers; i++) {
+        srv_worker_t *worker = switch_core_alloc(server.pool, sizeof(srv_worker_t));
+        uint32_t slots = globals.batch_max_size + 1;
+
+        worker->id = i;
+        if((worker->wstate = whisper_init_state(globals.wctx)) == NULL) {
+            switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "whisper_init_state()\n");
+            return 1;
+        }
+        worker->sjobs = switch_core_alloc(server.pool, slots * sizeof(srv_job_t *));
+        worker->jobs = switch_core_alloc(server.pool, slots * sizeof(wasr_job_t));
+        worker->text_buffers = switch_core_alloc(server.pool, slots * sizeof(switch_buffer_t *));
+        for(uint32_t j = 0; j < slots; j++) {
+            switch_buffer_create_dynamic(&worker->text_buffers[j], 1024, 1024, 0);
+        }
+        if(globals.batch_max_size > 1) {
+            switch_malloc(worker->pack_buffer, BATCH_MAX_SAMPLES * sizeof(float));
+        }
+
+        globals.active_threads++;
+        switch_threadattr_create(&attr, server.pool);
+        switch_threadattr_detach_set(attr, 1);
+        switch_threadattr_stacksize_set(attr, SWITCH_THREAD_STACKSIZE);
+        switch_thread_create(&thread, attr, worker_thread, worker, server.pool);
+    }
+
+    sa.sa_handler = signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Listening on %s: %u workers, %s, batch up to %u [%s]\n",
+        server.address, globals.workers, (globals.cpu_budget ? "cpu budget" : "fixed threads"), globals.batch_max_size, whisper_print_system_info());
+
+    while(!server.fl_stop) {
+        struct pollfd pfd = { .fd = server.listen_fd, .events = POLLIN };
+        int fd = -1;
+
+        if(poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
+        if((fd = accept(server.listen_fd, NULL, NULL)) >= 0) {
+            server_accept(fd);
+        }
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Stopping...\n");
+
+    proto_close(server.listen_fd);
+    if(!strncasecmp(server.address, "unix:", 5)) {
+        unlink(server.address + 5);
+    }
+
+    globals.fl_shutdown = SWITCH_TRUE;
+    jobs_queue_interrupt_all(globals.q_jobs);
+    while(globals.active_threads > 0) {
+        switch_yield(100000);
+    }
+
+    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "jobs=%"SWITCH_UINT64_T_FMT", rejected=%"SWITCH_UINT64_T_FMT", cancelled=%"SWITCH_UINT64_T_FMT", audio=%.1f sec, rtf=%.3f, batches=%"SWITCH_UINT64_T_FMT" (fill=%.2f), fallbacks=%"SWITCH_UINT64_T_FMT", budget_hits=%"SWITCH_UINT64_T_FMT"\n",
+        globals.metrics.jobs, globals.metrics.jobs_rejected, globals.metrics.jobs_cancelled, (globals.metrics.audio_us / 1000000.0),
+        (globals.metrics.audio_us ? ((double)globals.metrics.inference_us / globals.metrics.audio_us) : 0.0), globals.metrics.batch_runs, metrics_batch_fill(&globals.metrics, globals.batch_max_size),
+        globals.metrics.decode_fallbacks, globals.metrics.decode_budget_hits);
+
+    whisper_free(globals.wctx);
+
+    return 0;
+}